@@ -0,0 +1,342 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "names.hpp"
+#include "varint.hpp"
+
+// Columnar trace format, shared by the plugin and the tools.
+//
+//   magic       "TTCOL\0", version, 0
+//   rows        varint
+//   strings     varint count, then varint length and bytes of each
+//   details     varint count, then varint length and bytes of each
+//   metadata    varint count, then key and JSON value as above
+//   columns     ts, dur, cat, name, function, detail, uid, file, module,
+//               bytes, dump_bytes, ir_size, nodes, pending; each is a
+//               varint byte length followed by one varint per row
+//
+// Timestamps are zigzag deltas from the previous row in nanoseconds, and
+// durations are nanoseconds. Names, functions, files and modules index the
+// string table. Details index the detail table, which holds the payloads of
+// inline records as JSON objects. Counter records keep their values in the
+// ir_size, nodes and pending columns. Optional values are stored as
+// value + 1, with 0 for none; dump_bytes is zigzag encoded first, and an
+// ir_size of 0 means none on slices.
+// Readers only interested in a few columns can skip the others by length.
+namespace columnar {
+
+constexpr unsigned char version = 1;
+
+enum class Category : unsigned char
+{
+  Unit,
+  Include,
+  Parse,
+  Genericize,
+  Pass,
+  Plugin,
+  Inline,
+  Counter,
+  Module,
+};
+
+constexpr std::size_t category_count = 9;
+
+inline auto category_name(Category cat) -> const char *
+{
+  static const char *const names[category_count] = {
+    "unit", "include", "parse", "genericize", "pass", "plugin", "inline", "counter", "module",
+  };
+  auto index = static_cast<std::size_t>(cat);
+  return index < category_count ? names[index] : "";
+}
+
+struct Row
+{
+  std::int64_t ts;
+  std::int64_t dur;
+  Category cat;
+  NameTable::Id name;
+  NameTable::Id function;
+  NameTable::Id detail;
+  unsigned int uid;
+  NameTable::Id file;
+  NameTable::Id module;
+  std::int64_t bytes;
+  bool dump;
+  std::int64_t dump_bytes;
+  std::int64_t ir_size;
+  std::int64_t nodes;
+  std::int64_t pending;
+
+  Row(std::int64_t ts, std::int64_t dur, Category cat, NameTable::Id name)
+    : ts(ts)
+    , dur(dur)
+    , cat(cat)
+    , name(name)
+    , function(NameTable::npos)
+    , detail(NameTable::npos)
+    , uid(-1u)
+    , file(NameTable::npos)
+    , module(NameTable::npos)
+    , bytes(-1)
+    , dump(false)
+    , dump_bytes(0)
+    , ir_size(0)
+    , nodes(-1)
+    , pending(-1)
+  {
+  }
+};
+
+enum Column
+{
+  Ts,
+  Dur,
+  Cat,
+  Name,
+  Function,
+  Detail,
+  Uid,
+  File,
+  Module,
+  Bytes,
+  DumpBytes,
+  IrSize,
+  Nodes,
+  Pending,
+  ColumnCount,
+};
+
+inline auto put_string(std::string &out, const char *data, std::size_t len) -> void
+{
+  put_varint(out, len);
+  out.append(data, len);
+}
+
+class Encoder
+{
+  std::string _columns[ColumnCount];
+  std::size_t _rows;
+  std::int64_t _last_ts;
+
+public:
+  Encoder()
+    : _rows(0)
+    , _last_ts(0)
+  {
+  }
+
+  auto rows() const -> std::size_t
+  {
+    return _rows;
+  }
+
+  auto add(const Row &row) -> void
+  {
+    auto id = [](NameTable::Id id) { return id == NameTable::npos ? 0 : std::uint64_t { id } + 1; };
+    put_varint(_columns[Ts], zigzag(row.ts - _last_ts));
+    put_varint(_columns[Dur], static_cast<std::uint64_t>(row.dur));
+    put_varint(_columns[Cat], static_cast<unsigned>(row.cat));
+    put_varint(_columns[Name], row.name);
+    put_varint(_columns[Function], id(row.function));
+    put_varint(_columns[Detail], id(row.detail));
+    put_varint(_columns[Uid], row.uid == -1u ? 0 : std::uint64_t { row.uid } + 1);
+    put_varint(_columns[File], id(row.file));
+    put_varint(_columns[Module], id(row.module));
+    put_varint(_columns[Bytes], row.bytes < 0 ? 0 : static_cast<std::uint64_t>(row.bytes) + 1);
+    put_varint(_columns[DumpBytes], row.dump ? zigzag(row.dump_bytes) + 1 : 0);
+    put_varint(_columns[IrSize], row.ir_size > 0 ? static_cast<std::uint64_t>(row.ir_size) : 0);
+    put_varint(_columns[Nodes], row.nodes < 0 ? 0 : static_cast<std::uint64_t>(row.nodes) + 1);
+    put_varint(_columns[Pending], row.pending < 0 ? 0 : static_cast<std::uint64_t>(row.pending) + 1);
+    _last_ts = row.ts;
+    ++_rows;
+  }
+
+  // Hands the encoded trace to write(data, len) piece by piece.
+  template <typename Write>
+  auto write(Write &&write, const NameTable &strings, const NameTable &details,
+    const std::vector<std::pair<std::string, std::string>> &metadata) const -> void
+  {
+    const char magic[8] = { 'T', 'T', 'C', 'O', 'L', '\0', static_cast<char>(version), 0 };
+    write(magic, sizeof(magic));
+
+    std::string header;
+    put_varint(header, _rows);
+    for (auto table : { &strings, &details }) {
+      put_varint(header, table->size());
+      for (NameTable::Id id = 0; id < table->size(); ++id) {
+        put_string(header, table->str(id), table->length(id));
+      }
+    }
+    put_varint(header, metadata.size());
+    for (const auto &entry : metadata) {
+      put_string(header, entry.first.data(), entry.first.size());
+      put_string(header, entry.second.data(), entry.second.size());
+    }
+    write(header.data(), header.size());
+
+    for (const auto &column : _columns) {
+      header.clear();
+      put_varint(header, column.size());
+      write(header.data(), header.size());
+      write(column.data(), column.size());
+    }
+  }
+};
+
+// Parses a columnar trace held in memory. The tables are interned into the
+// given NameTables, and the columns are decoded lazily by for_each_row().
+class Reader
+{
+  const char *_begin;
+  const char *_end;
+  std::size_t _rows;
+  std::vector<NameTable::Id> _strings;
+  std::vector<NameTable::Id> _details;
+  std::pair<const char *, const char *> _columns[ColumnCount];
+
+public:
+  Reader(const char *begin, const char *end)
+    : _begin(begin)
+    , _end(end)
+    , _rows(0)
+  {
+  }
+
+  static auto matches(const char *begin, const char *end) -> bool
+  {
+    return end - begin >= 8 and std::memcmp(begin, "TTCOL", 6) == 0;
+  }
+
+  auto rows() const -> std::size_t
+  {
+    return _rows;
+  }
+
+  auto column(Column column) const -> std::pair<const char *, const char *>
+  {
+    return _columns[column];
+  }
+
+  auto read(NameTable &strings, NameTable &details, std::vector<std::pair<std::string, std::string>> &metadata)
+    -> bool
+  {
+    if (not matches(_begin, _end) or static_cast<unsigned char>(_begin[6]) != version) {
+      return false;
+    }
+
+    auto in = _begin + 8;
+    std::uint64_t count;
+    if (not get_varint(in, _end, count)) {
+      return false;
+    }
+    _rows = count;
+
+    if (not read_table(in, strings, _strings) or not read_table(in, details, _details)) {
+      return false;
+    }
+
+    if (not get_varint(in, _end, count)) {
+      return false;
+    }
+    for (std::uint64_t i = 0; i < count; ++i) {
+      std::pair<std::string, std::string> entry;
+      if (not read_string(in, entry.first) or not read_string(in, entry.second)) {
+        return false;
+      }
+      metadata.push_back(std::move(entry));
+    }
+
+    for (auto &column : _columns) {
+      std::uint64_t len;
+      if (not get_varint(in, _end, len) or len > static_cast<std::uint64_t>(_end - in)) {
+        return false;
+      }
+      column = { in, in + len };
+      in += len;
+    }
+    return true;
+  }
+
+  template <typename F>
+  auto for_each_row(F &&f) const -> bool
+  {
+    std::pair<const char *, const char *> cursors[ColumnCount];
+    std::copy(std::begin(_columns), std::end(_columns), std::begin(cursors));
+
+    std::int64_t ts = 0;
+    for (std::size_t i = 0; i < _rows; ++i) {
+      std::uint64_t values[ColumnCount] = {};
+      for (auto c = 0; c < ColumnCount; ++c) {
+        if (not get_varint(cursors[c].first, cursors[c].second, values[c])) {
+          return false;
+        }
+      }
+      if (values[Cat] >= category_count or values[Name] >= _strings.size() or values[Function] > _strings.size()
+        or values[Detail] > _details.size() or values[File] > _strings.size() or values[Module] > _strings.size()) {
+        return false;
+      }
+
+      auto string = [&](std::uint64_t value) { return value ? _strings[value - 1] : NameTable::npos; };
+      ts += unzigzag(values[Ts]);
+      Row row { ts, static_cast<std::int64_t>(values[Dur]), static_cast<Category>(values[Cat]), _strings[values[Name]] };
+      row.function = string(values[Function]);
+      row.detail = values[Detail] ? _details[values[Detail] - 1] : NameTable::npos;
+      row.uid = values[Uid] ? static_cast<unsigned int>(values[Uid] - 1) : -1u;
+      row.file = string(values[File]);
+      row.module = string(values[Module]);
+      row.bytes = static_cast<std::int64_t>(values[Bytes]) - 1;
+      row.dump = values[DumpBytes] != 0;
+      row.dump_bytes = row.dump ? unzigzag(values[DumpBytes] - 1) : 0;
+      row.ir_size = static_cast<std::int64_t>(values[IrSize]);
+      row.nodes = static_cast<std::int64_t>(values[Nodes]) - 1;
+      row.pending = static_cast<std::int64_t>(values[Pending]) - 1;
+      f(row);
+    }
+    return true;
+  }
+
+private:
+  auto read_string(const char *&in, std::string &out) -> bool
+  {
+    std::uint64_t len;
+    if (not get_varint(in, _end, len) or len > static_cast<std::uint64_t>(_end - in)) {
+      return false;
+    }
+    out.assign(in, len);
+    in += len;
+    return true;
+  }
+
+  auto read_table(const char *&in, NameTable &table, std::vector<NameTable::Id> &ids) -> bool
+  {
+    std::uint64_t count;
+    if (not get_varint(in, _end, count)) {
+      return false;
+    }
+    for (std::uint64_t i = 0; i < count; ++i) {
+      std::uint64_t len;
+      if (not get_varint(in, _end, len) or len > static_cast<std::uint64_t>(_end - in)) {
+        return false;
+      }
+      ids.push_back(table.intern(in, len));
+      in += len;
+    }
+    return true;
+  }
+};
+
+} // namespace columnar
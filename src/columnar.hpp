@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "column.hpp"
+#include "escape.hpp"
+#include "event.hpp"
+#include "names.hpp"
+#include "output.hpp"
+#include "sink.hpp"
+
+class ColumnarWriter
+{
+  Output &_out;
+  const NameTable &_names;
+  EventTimePoint _epoch;
+
+  NameTable::Id _inline_name;
+  NameTable::Id _counter_name;
+  NameTable _details;
+  columnar::Encoder _encoder;
+  std::vector<std::pair<std::string, std::string>> _metadata;
+  std::string _detail;
+
+public:
+  ColumnarWriter(const ColumnarWriter &) = delete;
+  ColumnarWriter(ColumnarWriter &&) = delete;
+
+  ColumnarWriter(Output &out, NameTable &names, EventTimePoint epoch)
+    : _out(out)
+    , _names(names)
+    , _epoch(epoch)
+    , _inline_name(names.intern("inlined_callees"))
+    , _counter_name(names.intern("callgraph"))
+  {
+  }
+
+  ~ColumnarWriter()
+  {
+    _encoder.write([this](const char *data, std::size_t len) { _out.write(data, len); }, _names, _details, _metadata);
+  }
+
+  auto write_metadata(const std::string &key, const std::string &json) -> void
+  {
+    _metadata.emplace_back(key, json);
+  }
+
+  auto write_slice(const Slice &slice) -> void
+  {
+    auto row = make_row(slice_category(slice.kind), slice.name, slice.start, slice.end);
+    row.function = slice.function;
+    row.uid = slice.uid;
+    row.file = slice.file;
+    row.module = slice.module;
+    row.bytes = slice.bytes;
+    row.dump = slice.dump;
+    row.dump_bytes = slice.dump_bytes;
+    row.ir_size = slice.ir_size;
+    _encoder.add(row);
+  }
+
+  auto write_inline(const EventRecord<InlineEvent> &record) -> void
+  {
+    _detail = "{\"pass\":";
+    append_string(record.event.pass.c_str());
+    _detail += ",\"uid\":" + std::to_string(record.event.uid);
+    _detail += ",\"size\":" + std::to_string(record.event.size);
+    _detail += ",\"callees\":[";
+    for (auto it = record.event.callees.cbegin(); it != record.event.callees.cend(); ++it) {
+      _detail += it == record.event.callees.cbegin() ? "{\"function\":" : ",{\"function\":";
+      append_string(_names.str(_names.find_decl(it->uid)));
+      _detail += ",\"uid\":" + std::to_string(it->uid);
+      _detail += ",\"size\":" + std::to_string(it->size) + "}";
+    }
+    _detail += "]}";
+    auto row = make_row(columnar::Category::Inline, _inline_name, record.timestamp, record.timestamp);
+    row.function = _names.find_decl(record.event.uid);
+    row.uid = record.event.uid;
+    row.detail = _details.intern(_detail.data(), _detail.size());
+    _encoder.add(row);
+  }
+
+  auto write_counter(const EventRecord<CounterEvent> &record) -> void
+  {
+    auto row = make_row(columnar::Category::Counter, _counter_name, record.timestamp, record.timestamp);
+    row.nodes = record.event.nodes;
+    row.pending = record.event.pending;
+    row.ir_size = record.event.ir_size;
+    _encoder.add(row);
+  }
+
+private:
+  auto make_row(columnar::Category cat, NameTable::Id name, EventTimePoint start, EventTimePoint end) const
+    -> columnar::Row
+  {
+    auto ts = std::chrono::duration_cast<std::chrono::nanoseconds>(start - _epoch).count();
+    auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    return { ts, dur, cat, name };
+  }
+
+  auto append_string(const char *str) -> void
+  {
+    escape_json_string(str, std::strlen(str), [this](const char *data, std::size_t len) { _detail.append(data, len); });
+  }
+};
@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <cstddef>
+
+// Passes the len bytes at str, quoted and escaped as a JSON string, to
+// append(data, len). Control characters are written as \u00XX.
+template <typename Append>
+inline auto escape_json_string(const char *str, std::size_t len, Append &&append) -> void
+{
+  static const char hex[] = "0123456789abcdef";
+  append("\"", 1);
+  auto end = str + len;
+  auto run = str;
+  for (auto it = str; it != end; ++it) {
+    auto c = static_cast<unsigned char>(*it);
+    if (c == '"' or c == '\\') {
+      append(run, it - run);
+      const char escaped[] = { '\\', static_cast<char>(c) };
+      append(escaped, sizeof(escaped));
+      run = it + 1;
+    } else if (c < 0x20) {
+      append(run, it - run);
+      const char escaped[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+      append(escaped, sizeof(escaped));
+      run = it + 1;
+    }
+  }
+  append(run, end - run);
+  append("\"", 1);
+}
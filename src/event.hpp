@@ -9,6 +9,7 @@
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <gcc-plugin.h>
 
@@ -33,6 +34,7 @@ struct IncludeEvent
 {
   IncludeEventKind kind;
   std::string filename;
+  unsigned int depth;
 };
 
 enum class ParseEventKind
@@ -61,12 +63,54 @@ struct PassEvent
   std::string name;
   tree decl;
   unsigned int uid;
+  bool dump;
+  long dump_bytes;
+  long ir_size;
+};
+
+struct InlineCallee
+{
+  tree decl;
+  unsigned int uid;
+  int size;
+};
+
+struct InlineEvent
+{
+  std::string pass;
+  tree decl;
+  unsigned int uid;
+  int size;
+  std::vector<InlineCallee> callees;
+};
+
+struct CounterEvent
+{
+  long nodes;
+  long pending;
+  long ir_size;
 };
 
 using EventClock = std::chrono::steady_clock;
 using EventDuration = EventClock::duration;
 using EventTimePoint = EventClock::time_point;
 
+enum class ModuleEventKind
+{
+  Translate,
+  Import,
+  Write,
+};
+
+struct ModuleEvent
+{
+  ModuleEventKind kind;
+  std::string module;
+  std::string file;
+  long bytes;
+  EventDuration duration;
+};
+
 template <typename Event>
 struct EventRecord
 {
@@ -78,6 +122,12 @@ struct EventRecord
     , timestamp(EventClock::now())
   {
   }
+
+  EventRecord(Event event, EventTimePoint timestamp)
+    : timestamp(timestamp)
+    , event(std::move(event))
+  {
+  }
 };
 
 template <typename Callback>
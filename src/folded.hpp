@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "event.hpp"
+#include "names.hpp"
+#include "output.hpp"
+#include "sink.hpp"
+
+class FoldedWriter
+{
+  struct Frame
+  {
+    EventTimePoint start;
+    EventTimePoint end;
+    NameTable::Id label;
+  };
+
+  struct OpenFrame
+  {
+    EventTimePoint end;
+    EventDuration duration;
+    EventDuration children;
+    std::size_t parent_length;
+  };
+
+  Output &_out;
+  const NameTable &_names;
+  std::vector<Frame> _frames;
+
+public:
+  FoldedWriter(const FoldedWriter &) = delete;
+  FoldedWriter(FoldedWriter &&) = delete;
+
+  FoldedWriter(Output &out, const NameTable &names)
+    : _out(out)
+    , _names(names)
+  {
+  }
+
+  ~FoldedWriter()
+  {
+    std::sort(_frames.begin(), _frames.end(), [](const Frame &a, const Frame &b) {
+      return a.start != b.start ? a.start < b.start : a.end > b.end;
+    });
+
+    std::map<std::string, long> stacks;
+    std::vector<OpenFrame> open;
+    std::string path;
+    auto close = [&]() {
+      auto self = std::max(open.back().duration - open.back().children, EventDuration::zero());
+      stacks[path] += std::chrono::duration_cast<std::chrono::microseconds>(self).count();
+      path.resize(open.back().parent_length);
+      open.pop_back();
+    };
+
+    for (const auto &frame : _frames) {
+      while (not open.empty() and open.back().end <= frame.start) {
+        close();
+      }
+      if (not open.empty()) {
+        open.back().children += frame.end - frame.start;
+      }
+      open.push_back({ frame.end, frame.end - frame.start, EventDuration::zero(), path.size() });
+      if (not path.empty()) {
+        path += ';';
+      }
+      for (auto c = _names.str(frame.label); *c; ++c) {
+        path += *c == ';' ? ':' : *c == '\n' ? ' ' : *c;
+      }
+    }
+    while (not open.empty()) {
+      close();
+    }
+
+    for (const auto &stack : stacks) {
+      if (stack.second > 0) {
+        _out.printf("%s %ld\n", stack.first.c_str(), stack.second);
+      }
+    }
+  }
+
+  auto write_metadata(const std::string &, const std::string &) -> void
+  {
+  }
+
+  auto write_slice(const Slice &slice) -> void
+  {
+    if (slice.start != slice.end) {
+      _frames.push_back({ slice.start, slice.end, slice.kind == SliceKind::Include ? slice.file : slice.name });
+    }
+  }
+
+  auto write_inline(const EventRecord<InlineEvent> &) -> void
+  {
+  }
+
+  auto write_counter(const EventRecord<CounterEvent> &) -> void
+  {
+  }
+};
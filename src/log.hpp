@@ -0,0 +1,390 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "event.hpp"
+#include "varint.hpp"
+
+#include <gcc-plugin.h>
+
+#include <coretypes.h>
+#include <tree.h>
+
+// The first error of the spill files, as an errno value. Logs stop spilling
+// after it and keep their chunks in memory.
+struct MemoryBudget
+{
+  std::size_t limit;
+  std::size_t used;
+  int spill_error;
+};
+
+namespace pack {
+
+// Spill chunks are written by this process, so they are read without bounds.
+inline auto get_varint(const char *&in) -> std::uint64_t
+{
+  std::uint64_t value;
+  ::get_varint(in, nullptr, value);
+  return value;
+}
+
+inline auto put_signed(std::string &out, std::int64_t value) -> void
+{
+  put_varint(out, zigzag(value));
+}
+
+inline auto get_signed(const char *&in) -> std::int64_t
+{
+  return unzigzag(get_varint(in));
+}
+
+inline auto put_string(std::string &out, const std::string &value) -> void
+{
+  put_varint(out, value.size());
+  out += value;
+}
+
+inline auto get_string(const char *&in) -> std::string
+{
+  auto len = get_varint(in);
+  std::string value { in, static_cast<std::size_t>(len) };
+  in += len;
+  return value;
+}
+
+inline auto put_tree(std::string &out, tree decl) -> void
+{
+  put_varint(out, reinterpret_cast<std::uintptr_t>(decl));
+}
+
+inline auto get_tree(const char *&in) -> tree
+{
+  return reinterpret_cast<tree>(static_cast<std::uintptr_t>(get_varint(in)));
+}
+
+inline auto put(std::string &out, const UnitEvent &event) -> void
+{
+  put_varint(out, static_cast<unsigned>(event.kind));
+}
+
+inline auto get(const char *&in, UnitEvent &event) -> void
+{
+  event.kind = static_cast<UnitEventKind>(get_varint(in));
+}
+
+inline auto put(std::string &out, const IncludeEvent &event) -> void
+{
+  put_varint(out, static_cast<unsigned>(event.kind));
+  put_string(out, event.filename);
+  put_varint(out, event.depth);
+}
+
+inline auto get(const char *&in, IncludeEvent &event) -> void
+{
+  event.kind = static_cast<IncludeEventKind>(get_varint(in));
+  event.filename = get_string(in);
+  event.depth = get_varint(in);
+}
+
+inline auto put(std::string &out, const ParseEvent &event) -> void
+{
+  put_varint(out, static_cast<unsigned>(event.kind));
+  put_tree(out, event.decl);
+  put_varint(out, event.uid);
+}
+
+inline auto get(const char *&in, ParseEvent &event) -> void
+{
+  event.kind = static_cast<ParseEventKind>(get_varint(in));
+  event.decl = get_tree(in);
+  event.uid = get_varint(in);
+}
+
+inline auto put(std::string &out, const PassEvent &event) -> void
+{
+  put_varint(out, static_cast<unsigned>(event.kind));
+  put_string(out, event.name);
+  put_tree(out, event.decl);
+  put_varint(out, event.uid);
+  put_varint(out, event.dump);
+  put_signed(out, event.dump_bytes);
+  put_signed(out, event.ir_size);
+}
+
+inline auto get(const char *&in, PassEvent &event) -> void
+{
+  event.kind = static_cast<PassEventKind>(get_varint(in));
+  event.name = get_string(in);
+  event.decl = get_tree(in);
+  event.uid = get_varint(in);
+  event.dump = get_varint(in);
+  event.dump_bytes = get_signed(in);
+  event.ir_size = get_signed(in);
+}
+
+inline auto put(std::string &out, const InlineEvent &event) -> void
+{
+  put_string(out, event.pass);
+  put_tree(out, event.decl);
+  put_varint(out, event.uid);
+  put_signed(out, event.size);
+  put_varint(out, event.callees.size());
+  for (const auto &callee : event.callees) {
+    put_tree(out, callee.decl);
+    put_varint(out, callee.uid);
+    put_signed(out, callee.size);
+  }
+}
+
+inline auto get(const char *&in, InlineEvent &event) -> void
+{
+  event.pass = get_string(in);
+  event.decl = get_tree(in);
+  event.uid = get_varint(in);
+  event.size = get_signed(in);
+  event.callees.resize(get_varint(in));
+  for (auto &callee : event.callees) {
+    callee.decl = get_tree(in);
+    callee.uid = get_varint(in);
+    callee.size = get_signed(in);
+  }
+}
+
+inline auto put(std::string &out, const CounterEvent &event) -> void
+{
+  put_signed(out, event.nodes);
+  put_signed(out, event.pending);
+  put_signed(out, event.ir_size);
+}
+
+inline auto get(const char *&in, CounterEvent &event) -> void
+{
+  event.nodes = get_signed(in);
+  event.pending = get_signed(in);
+  event.ir_size = get_signed(in);
+}
+
+inline auto put(std::string &out, const ModuleEvent &event) -> void
+{
+  put_varint(out, static_cast<unsigned>(event.kind));
+  put_string(out, event.module);
+  put_string(out, event.file);
+  put_signed(out, event.bytes);
+  put_signed(out, event.duration.count());
+}
+
+inline auto get(const char *&in, ModuleEvent &event) -> void
+{
+  event.kind = static_cast<ModuleEventKind>(get_varint(in));
+  event.module = get_string(in);
+  event.file = get_string(in);
+  event.bytes = get_signed(in);
+  event.duration = EventDuration { get_signed(in) };
+}
+
+inline auto heap_size(const std::string &value) -> std::size_t
+{
+  return value.capacity() > 15 ? value.capacity() + 1 : 0;
+}
+
+inline auto heap_size(const UnitEvent &) -> std::size_t
+{
+  return 0;
+}
+
+inline auto heap_size(const IncludeEvent &event) -> std::size_t
+{
+  return heap_size(event.filename);
+}
+
+inline auto heap_size(const ParseEvent &) -> std::size_t
+{
+  return 0;
+}
+
+inline auto heap_size(const PassEvent &event) -> std::size_t
+{
+  return heap_size(event.name);
+}
+
+inline auto heap_size(const InlineEvent &event) -> std::size_t
+{
+  return heap_size(event.pass) + event.callees.capacity() * sizeof(InlineCallee);
+}
+
+inline auto heap_size(const CounterEvent &) -> std::size_t
+{
+  return 0;
+}
+
+inline auto heap_size(const ModuleEvent &event) -> std::size_t
+{
+  return heap_size(event.module) + heap_size(event.file);
+}
+
+} // namespace pack
+
+// Append-only log of event records. Once the memory budget shared by all
+// logs is exceeded, full chunks are packed and spilled to a temporary file,
+// and streamed back in order by for_each().
+template <typename Event>
+class EventLog
+{
+  using Chunk = std::vector<EventRecord<Event>>;
+
+  static constexpr std::size_t chunk_size = 4096;
+
+  MemoryBudget &_budget;
+  std::vector<Chunk> _chunks;
+  std::vector<std::size_t> _chunk_bytes;
+  std::FILE *_spill;
+  std::size_t _spilled_chunks;
+  EventTimePoint _first;
+
+public:
+  EventLog(const EventLog &) = delete;
+  EventLog(EventLog &&) = delete;
+
+  EventLog(MemoryBudget &budget)
+    : _budget(budget)
+    , _spill(nullptr)
+    , _spilled_chunks(0)
+    , _first(EventTimePoint::max())
+  {
+  }
+
+  ~EventLog()
+  {
+    if (_spill) {
+      std::fclose(_spill);
+    }
+  }
+
+  auto empty() const -> bool
+  {
+    return _chunks.empty() and _spilled_chunks == 0;
+  }
+
+  auto first_timestamp() const -> EventTimePoint
+  {
+    return _first;
+  }
+
+  auto spilled_chunks() const -> std::size_t
+  {
+    return _spilled_chunks;
+  }
+
+  auto push(EventRecord<Event> record) -> void
+  {
+    if (_chunks.empty() or _chunks.back().size() == chunk_size) {
+      _chunks.emplace_back();
+      _chunks.back().reserve(chunk_size);
+      _chunk_bytes.push_back(chunk_size * sizeof(EventRecord<Event>));
+      _budget.used += _chunk_bytes.back();
+    }
+    if (_first == EventTimePoint::max()) {
+      _first = record.timestamp;
+    }
+
+    auto bytes = pack::heap_size(record.event);
+    _chunk_bytes.back() += bytes;
+    _budget.used += bytes;
+    _chunks.back().push_back(std::move(record));
+
+    if (_budget.limit > 0 and _budget.used > _budget.limit) {
+      spill();
+    }
+  }
+
+  template <typename F>
+  auto for_each(F &&f) -> void
+  {
+    if (_spill) {
+      std::fflush(_spill);
+      std::rewind(_spill);
+
+      std::string buffer;
+      errno = 0;
+      for (std::size_t i = 0; i < _spilled_chunks; ++i) {
+        std::uint64_t header[3];
+        if (std::fread(header, sizeof(header), 1, _spill) != 1) {
+          _budget.spill_error = errno ? errno : EIO;
+          break;
+        }
+        buffer.resize(header[0]);
+        if (std::fread(&buffer[0], 1, buffer.size(), _spill) != buffer.size()) {
+          _budget.spill_error = errno ? errno : EIO;
+          break;
+        }
+
+        auto in = buffer.data();
+        auto last = static_cast<std::int64_t>(header[2]);
+        for (std::uint64_t j = 0; j < header[1]; ++j) {
+          last += pack::get_signed(in);
+          EventRecord<Event> record { Event {}, EventTimePoint { EventDuration { last } } };
+          pack::get(in, record.event);
+          f(record);
+        }
+      }
+    }
+
+    for (auto &chunk : _chunks) {
+      for (auto &record : chunk) {
+        f(record);
+      }
+    }
+  }
+
+private:
+  auto spill() -> void
+  {
+    if (_chunks.size() < 2 or _budget.spill_error) {
+      return;
+    }
+    if (not _spill and not(_spill = std::tmpfile())) {
+      _budget.spill_error = errno ? errno : EIO;
+      return;
+    }
+
+    std::string buffer;
+    std::size_t i = 0;
+    for (; i + 1 < _chunks.size(); ++i) {
+      buffer.clear();
+      auto first = static_cast<std::int64_t>(_chunks[i].front().timestamp.time_since_epoch().count());
+      auto last = first;
+      for (const auto &record : _chunks[i]) {
+        auto ts = static_cast<std::int64_t>(record.timestamp.time_since_epoch().count());
+        pack::put_signed(buffer, ts - last);
+        pack::put(buffer, record.event);
+        last = ts;
+      }
+
+      std::uint64_t header[3] = { buffer.size(), _chunks[i].size(), static_cast<std::uint64_t>(first) };
+      // A chunk counts as spilled once it is flushed, so a failed write leaves
+      // only a tail that for_each() never reads.
+      errno = 0;
+      if (std::fwrite(header, sizeof(header), 1, _spill) != 1
+        or std::fwrite(buffer.data(), 1, buffer.size(), _spill) != buffer.size() or std::fflush(_spill) != 0) {
+        _budget.spill_error = errno ? errno : EIO;
+        break;
+      }
+      _budget.used -= _chunk_bytes[i];
+      ++_spilled_chunks;
+    }
+
+    _chunks.erase(_chunks.begin(), _chunks.begin() + i);
+    _chunk_bytes.erase(_chunk_bytes.begin(), _chunk_bytes.begin() + i);
+  }
+};
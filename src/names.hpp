@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Flat open addressing map from decl uids to ids of a NameTable.
+class UidMap
+{
+public:
+  using Id = std::uint32_t;
+
+  enum : Id
+  {
+    npos = 0xffffffffu,
+  };
+
+private:
+  struct Slot
+  {
+    unsigned int uid;
+    Id id;
+  };
+
+  std::vector<Slot> _slots;
+  std::size_t _count;
+
+public:
+  UidMap()
+    : _slots(256, Slot { 0, npos })
+    , _count(0)
+  {
+  }
+
+  auto find(unsigned int uid) const -> Id
+  {
+    auto mask = _slots.size() - 1;
+    for (auto i = hash(uid) & mask;; i = (i + 1) & mask) {
+      const auto &slot = _slots[i];
+      if (slot.id == npos or slot.uid == uid) {
+        return slot.id;
+      }
+    }
+  }
+
+  auto insert(unsigned int uid, Id id) -> void
+  {
+    auto mask = _slots.size() - 1;
+    for (auto i = hash(uid) & mask;; i = (i + 1) & mask) {
+      auto &slot = _slots[i];
+      if (slot.id == npos or slot.uid == uid) {
+        auto inserted = slot.id == npos;
+        slot = { uid, id };
+        if (inserted and ++_count * 10 > _slots.size() * 7) {
+          grow();
+        }
+        return;
+      }
+    }
+  }
+
+  template <typename F>
+  auto for_each(F &&f) const -> void
+  {
+    for (const auto &slot : _slots) {
+      if (slot.id != npos) {
+        f(slot.uid, slot.id);
+      }
+    }
+  }
+
+private:
+  static auto hash(unsigned int uid) -> std::size_t
+  {
+    return static_cast<std::size_t>((static_cast<std::uint64_t>(uid) * 0x9e3779b97f4a7c15ull) >> 32);
+  }
+
+  auto grow() -> void
+  {
+    std::vector<Slot> slots(_slots.size() * 2, Slot { 0, npos });
+    auto mask = slots.size() - 1;
+    for (const auto &slot : _slots) {
+      if (slot.id != npos) {
+        auto i = hash(slot.uid) & mask;
+        while (slots[i].id != npos) {
+          i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+      }
+    }
+    _slots.swap(slots);
+  }
+};
+
+class NameTable
+{
+public:
+  using Id = UidMap::Id;
+
+  enum : Id
+  {
+    npos = UidMap::npos,
+  };
+
+private:
+  struct Entry
+  {
+    std::uint32_t offset;
+    std::uint32_t length;
+    std::uint32_t hash;
+  };
+
+  std::vector<char> _arena;
+  std::vector<Entry> _entries;
+  std::vector<Id> _string_slots;
+  UidMap _decls;
+
+public:
+  NameTable()
+    : _string_slots(256, npos)
+  {
+  }
+
+  auto size() const -> std::size_t
+  {
+    return _entries.size();
+  }
+
+  auto str(Id id) const -> const char *
+  {
+    return _arena.data() + _entries[id].offset;
+  }
+
+  auto length(Id id) const -> std::size_t
+  {
+    return _entries[id].length;
+  }
+
+  auto intern(const char *data, std::size_t len) -> Id
+  {
+    auto hash = hash_string(data, len);
+    auto mask = _string_slots.size() - 1;
+    for (auto i = hash & mask;; i = (i + 1) & mask) {
+      auto id = _string_slots[i];
+      if (id == npos) {
+        id = static_cast<Id>(_entries.size());
+        _entries.push_back({ static_cast<std::uint32_t>(_arena.size()), static_cast<std::uint32_t>(len), hash });
+        _arena.insert(_arena.end(), data, data + len);
+        _arena.push_back('\0');
+        _string_slots[i] = id;
+        if (_entries.size() * 10 > _string_slots.size() * 7) {
+          grow_strings();
+        }
+        return id;
+      }
+
+      const auto &entry = _entries[id];
+      if (entry.hash == hash and entry.length == len and std::memcmp(_arena.data() + entry.offset, data, len) == 0) {
+        return id;
+      }
+    }
+  }
+
+  auto intern(const char *data) -> Id
+  {
+    return intern(data, std::strlen(data));
+  }
+
+  auto find_decl(unsigned int uid) const -> Id
+  {
+    return _decls.find(uid);
+  }
+
+  auto insert_decl(unsigned int uid, Id id) -> void
+  {
+    _decls.insert(uid, id);
+  }
+
+  template <typename F>
+  auto for_each_decl(F &&f) const -> void
+  {
+    _decls.for_each(f);
+  }
+
+private:
+  static auto hash_string(const char *data, std::size_t len) -> std::uint32_t
+  {
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < len; ++i) {
+      hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+  }
+
+  auto grow_strings() -> void
+  {
+    std::vector<Id> slots(_string_slots.size() * 2, npos);
+    auto mask = slots.size() - 1;
+    for (Id id = 0; id < _entries.size(); ++id) {
+      auto i = _entries[id].hash & mask;
+      while (slots[i] != npos) {
+        i = (i + 1) & mask;
+      }
+      slots[i] = id;
+    }
+    _string_slots.swap(slots);
+  }
+};
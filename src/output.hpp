@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+enum class OutputMode
+{
+  Buffered,
+  Mapped,
+};
+
+// Output file of a writer. Text is formatted straight into a window of the
+// file mapped in memory, or into a large buffer written with pwrite when the
+// file cannot be mapped, e.g. on network filesystems. The first failure is
+// kept as an errno value, and nothing more is written after it.
+class Output
+{
+  static constexpr std::size_t buffer_size = 1 << 20;
+  static constexpr std::size_t window_size = 16 << 20;
+
+  int _fd;
+  int _error;
+  OutputMode _mode;
+  char *_data;
+  std::size_t _capacity;
+  std::size_t _used;
+  off_t _offset;
+  std::vector<char> _buffer;
+
+public:
+  Output(const Output &) = delete;
+  Output(Output &&) = delete;
+
+  Output()
+    : _fd(-1)
+    , _error(0)
+    , _mode(OutputMode::Buffered)
+    , _data(nullptr)
+    , _capacity(0)
+    , _used(0)
+    , _offset(0)
+  {
+  }
+
+  ~Output()
+  {
+    close();
+  }
+
+  auto open(const char *path, OutputMode mode) -> bool
+  {
+    _fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (_fd < 0) {
+      _error = errno;
+      return false;
+    }
+    if (mode == OutputMode::Mapped and mappable() and map_window()) {
+      _mode = OutputMode::Mapped;
+    } else {
+      use_buffer();
+    }
+    return true;
+  }
+
+  auto mode() const -> OutputMode
+  {
+    return _mode;
+  }
+
+  auto error() const -> int
+  {
+    return _error;
+  }
+
+  auto write(const char *data, std::size_t len) -> void
+  {
+    while (len > 0) {
+      if (_used == _capacity and not advance()) {
+        return;
+      }
+      auto n = std::min(len, _capacity - _used);
+      std::memcpy(_data + _used, data, n);
+      _used += n;
+      data += n;
+      len -= n;
+    }
+  }
+
+  auto put(char c) -> void
+  {
+    if (_used < _capacity or advance()) {
+      _data[_used++] = c;
+    }
+  }
+
+  __attribute__((format(printf, 2, 3))) auto printf(const char *format, ...) -> void
+  {
+    va_list args;
+    va_start(args, format);
+    auto space = _capacity - _used;
+    auto len = std::vsnprintf(_data + _used, space, format, args);
+    va_end(args);
+    if (len < 0) {
+      return;
+    }
+    if (static_cast<std::size_t>(len) < space) {
+      _used += len;
+      return;
+    }
+
+    std::vector<char> text(len + 1);
+    va_start(args, format);
+    std::vsnprintf(text.data(), text.size(), format, args);
+    va_end(args);
+    write(text.data(), len);
+  }
+
+  // Writes out the remaining data. Returns false if any write failed.
+  auto close() -> bool
+  {
+    if (_fd < 0) {
+      return _error == 0;
+    }
+    if (_mode == OutputMode::Mapped) {
+      ::munmap(_data, _capacity);
+      truncate(_offset + _used);
+    } else if (_error == 0) {
+      flush();
+    }
+    if (::close(_fd) != 0 and _error == 0) {
+      _error = errno;
+    }
+    _fd = -1;
+    return _error == 0;
+  }
+
+private:
+  auto mappable() const -> bool
+  {
+#ifdef __linux__
+    struct statfs stat;
+    if (::fstatfs(_fd, &stat) != 0) {
+      return false;
+    }
+    switch (static_cast<unsigned long>(stat.f_type)) {
+    case 0x6969ul:     // NFS
+    case 0x517bul:     // SMB
+    case 0xff534d42ul: // CIFS
+    case 0xfe534d42ul: // SMB2
+    case 0x00c36400ul: // Ceph
+    case 0x5346414ful: // AFS
+    case 0x0bd00bd0ul: // Lustre
+    case 0x01021997ul: // 9P
+    case 0x65735546ul: // FUSE
+      return false;
+    default:
+      return true;
+    }
+#else
+    return false;
+#endif
+  }
+
+  // Preallocates and maps the window of the file at _offset. The blocks are
+  // allocated up front so that a full disk is reported here instead of as
+  // SIGBUS when writing to the mapping.
+  auto map_window() -> bool
+  {
+#ifdef __linux__
+    if (::fallocate(_fd, 0, _offset, window_size) != 0) {
+      return false;
+    }
+    auto data = ::mmap(nullptr, window_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, _offset);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+    _data = static_cast<char *>(data);
+    _capacity = window_size;
+    _used = 0;
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // Cuts off the preallocated space after the data.
+  auto truncate(off_t size) -> void
+  {
+    while (::ftruncate(_fd, size) != 0) {
+      if (errno != EINTR) {
+        _error = _error ? _error : errno;
+        return;
+      }
+    }
+  }
+
+  auto use_buffer() -> void
+  {
+    _mode = OutputMode::Buffered;
+    _buffer.resize(buffer_size);
+    _data = _buffer.data();
+    _capacity = _buffer.size();
+    _used = 0;
+  }
+
+  auto flush() -> bool
+  {
+    for (std::size_t done = 0; done < _used;) {
+      auto n = ::pwrite(_fd, _data + done, _used - done, _offset + done);
+      if (n < 0 and errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        _error = n < 0 ? errno : ENOSPC;
+        _used = 0;
+        return false;
+      }
+      done += n;
+    }
+    _offset += _used;
+    _used = 0;
+    return true;
+  }
+
+  auto advance() -> bool
+  {
+    if (_error) {
+      return false;
+    }
+    if (_mode == OutputMode::Buffered) {
+      return flush();
+    }
+
+    ::munmap(_data, _capacity);
+    _offset += _capacity;
+    if (map_window()) {
+      return true;
+    }
+    truncate(_offset);
+    use_buffer();
+    return true;
+  }
+};
@@ -2,14 +2,36 @@
 // SPDX-FileCopyrightText: 2024 Shota Minami
 
 #include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <forward_list>
+#include <initializer_list>
+#include <iterator>
+#include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+#include "columnar.hpp"
+#include "escape.hpp"
 #include "event.hpp"
+#include "folded.hpp"
+#include "log.hpp"
+#include "names.hpp"
+#include "output.hpp"
+#include "scope.hpp"
+#include "sink.hpp"
+#include "summary.hpp"
 #include "writer.hpp"
 
 #include <gcc-plugin.h>
@@ -23,6 +45,7 @@
 #include <intl.h>
 #include <line-map.h>
 #include <options.h>
+#include <opts.h>
 #include <pass_manager.h>
 #include <plugin-version.h>
 #include <plugin.h>
@@ -32,6 +55,19 @@
 #include <tree-pass.h>
 #include <tree.h>
 
+#include <backend.h>
+#include <rtl.h>
+#include <gimple.h>
+#include <gimple-iterator.h>
+#include <cgraph.h>
+#if GCCPLUGIN_VERSION_MAJOR >= 8
+#include <alloc-pool.h>
+#include <symbol-summary.h>
+#include <tree-vrp.h>
+#include <ipa-prop.h>
+#include <ipa-fnsummary.h>
+#endif
+
 int plugin_is_GPL_compatible;
 
 enum class TimeTracePassKind
@@ -66,22 +102,801 @@ private:
   }
 };
 
+struct DumpProbe
+{
+  std::string pass_name;
+  std::string filename;
+  long size;
+};
+
+struct PassFrame
+{
+  std::string name;
+  EventTimePoint start;
+  bool recorded;
+};
+
+struct PassAggregate
+{
+  long count;
+  double total;
+  long recorded_count;
+  double recorded_total;
+  double recorded_total_sq;
+};
+
+enum class Degradation
+{
+  None,
+  FunctionPasses,
+  Includes,
+  PassLists,
+  Exhausted,
+};
+
+struct DegradationStep
+{
+  Degradation level;
+  unsigned long events;
+  unsigned long bytes;
+  EventTimePoint timestamp;
+};
+
+struct TraceBudget
+{
+  unsigned long max_events;
+  unsigned long max_bytes;
+  unsigned long events;
+  unsigned long bytes;
+  Degradation level;
+  std::vector<DegradationStep> steps;
+  unsigned long dropped_includes;
+  unsigned long dropped_parses;
+  unsigned long dropped_records;
+};
+
+constexpr unsigned int collapsed_include_depth = 2;
+
 int decl_verbosity;
 bool version_check;
+bool inline_callees;
+cgraph_node *early_inline_caller;
+std::vector<InlineCallee> early_inlined;
+bool counters;
+bool pass_ir_size;
+bool scopes;
+unsigned long sample_rate;
+std::vector<const char *> select_globs;
+unsigned long select_rate;
+bool output_json;
+bool output_summary;
+bool output_folded;
+bool output_columnar;
+OutputMode output_mode;
 void (*old_cb_file_change)(cpp_reader *, const line_map_ordinary *);
+unsigned int include_depth;
+unsigned int scanned_line_maps;
+std::vector<bool> include_recorded;
+std::vector<unsigned int> open_parses;
+
+MemoryBudget memory_budget;
+
+EventLog<UnitEvent> trace_unit { memory_budget };
+EventLog<IncludeEvent> trace_include { memory_budget };
+EventLog<ParseEvent> trace_parse { memory_budget };
+EventLog<PassEvent> trace_pass { memory_budget };
+
+EventLog<InlineEvent> trace_inline { memory_budget };
+EventLog<CounterEvent> trace_counter { memory_budget };
+EventLog<ModuleEvent> trace_module { memory_budget };
+
+std::vector<DumpProbe> dump_probes;
+
+TraceBudget trace_budget;
+
+std::unordered_map<unsigned int, bool> sampled_functions;
+std::vector<PassFrame> pass_frames;
+std::map<std::string, PassAggregate> pass_aggregates;
+
+std::unordered_map<unsigned int, long> ir_sizes;
+long ir_size_total;
+long pending_functions;
+bool expansion_started;
+
+static auto dump_file_size(const std::string &filename) -> long
+{
+  struct stat st;
+  return ::stat(filename.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+static auto start_dump_probe(const opt_pass *pass) -> void
+{
+  if (pass->static_pass_number == -1) {
+    return;
+  }
+
+  // A dump file is truncated when the pass first opens it in this compile, so
+  // a file left over from an earlier run does not count as the baseline.
+  auto dumps = ::g->get_dumps();
+  auto info = dumps->get_dump_file_info(pass->static_pass_number);
+  if (not info or info->pstate == 0) {
+    return;
+  }
+  auto filename = dumps->get_dump_file_name(pass->static_pass_number);
+  if (filename) {
+    dump_probes.push_back({ pass->name, filename, info->pstate < 0 ? 0 : dump_file_size(filename) });
+    ::free(filename);
+  }
+}
+
+static auto finish_dump_probe(PassEvent &event) -> void
+{
+  for (auto it = dump_probes.rbegin(); it != dump_probes.rend(); ++it) {
+    if (it->pass_name == event.name) {
+      event.dump = true;
+      event.dump_bytes = dump_file_size(it->filename) - it->size;
+      dump_probes.erase(std::prev(it.base()), dump_probes.end());
+      return;
+    }
+  }
+}
+
+constexpr std::uint64_t fnv_offset_basis = 14695981039346656037ull;
+
+static auto fnv_hash(std::uint64_t hash, const char *data, std::size_t len) -> std::uint64_t
+{
+  for (std::size_t i = 0; i < len; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+  }
+  return hash;
+}
+
+static auto sampling_hash(const char *data, std::size_t len) -> std::uint64_t
+{
+  auto hash = fnv_hash(fnv_offset_basis, data, len);
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static auto function_sampled(tree decl) -> bool
+{
+  auto uid = DECL_PT_UID(decl);
+  auto it = sampled_functions.find(uid);
+  if (it == sampled_functions.end()) {
+    std::uint64_t hash;
+    if (DECL_ASSEMBLER_NAME_SET_P(decl)) {
+      auto name = IDENTIFIER_POINTER(DECL_ASSEMBLER_NAME(decl));
+      hash = sampling_hash(name, std::strlen(name));
+    } else {
+      hash = sampling_hash(reinterpret_cast<const char *>(&uid), sizeof(uid));
+    }
+    it = sampled_functions.emplace(uid, hash % sample_rate == 0).first;
+  }
+  return it->second;
+}
+
+// plugin_init runs before main_input_filename is set, so the input file is
+// taken from the command line.
+static auto input_filename() -> const char *
+{
+  if (main_input_filename) {
+    return main_input_filename;
+  }
+  for (unsigned int i = 1; i < save_decoded_options_count; ++i) {
+    if (save_decoded_options[i].opt_index == OPT_SPECIAL_input_file) {
+      return save_decoded_options[i].arg;
+    }
+  }
+  return "";
+}
+
+static auto unit_selected() -> bool
+{
+  auto input = input_filename();
+  if (not select_globs.empty()
+    and std::none_of(select_globs.cbegin(), select_globs.cend(),
+      [&](const char *glob) { return ::fnmatch(glob, input, 0) == 0; })) {
+    return false;
+  }
+  return select_rate <= 1 or sampling_hash(input, std::strlen(input)) % select_rate == 0;
+}
+
+static auto budget_enabled() -> bool
+{
+  return trace_budget.max_events > 0 or trace_budget.max_bytes > 0;
+}
+
+static auto degraded(Degradation level) -> bool
+{
+  return trace_budget.level >= level;
+}
+
+static auto charge_event(std::size_t bytes) -> void
+{
+  if (not budget_enabled()) {
+    return;
+  }
+
+  trace_budget.events += 1;
+  trace_budget.bytes += 48 + bytes;
+
+  auto usage = 0.0;
+  if (trace_budget.max_events > 0) {
+    usage = std::max(usage, static_cast<double>(trace_budget.events) / trace_budget.max_events);
+  }
+  if (trace_budget.max_bytes > 0) {
+    usage = std::max(usage, static_cast<double>(trace_budget.bytes) / trace_budget.max_bytes);
+  }
+
+  auto level = usage >= 1.0 ? Degradation::Exhausted
+    : usage >= 0.9          ? Degradation::PassLists
+    : usage >= 0.75         ? Degradation::Includes
+    : usage >= 0.5          ? Degradation::FunctionPasses
+                            : Degradation::None;
+  if (level > trace_budget.level) {
+    trace_budget.level = level;
+    trace_budget.steps.push_back({ level, trace_budget.events, trace_budget.bytes, EventClock::now() });
+  }
+}
+
+static auto pass_recorded(bool list) -> bool
+{
+  if (::current_function_decl and (sample_rate > 1 or budget_enabled())) {
+    auto detail = list ? Degradation::Exhausted : Degradation::FunctionPasses;
+    return function_sampled(::current_function_decl) and not degraded(detail);
+  }
+  return list or not degraded(Degradation::PassLists);
+}
+
+static auto start_pass_frame(const std::string &name, bool list) -> bool
+{
+  if ((::current_function_decl and (sample_rate > 1 or budget_enabled())) or (not list and budget_enabled())) {
+    auto recorded = pass_recorded(list);
+    pass_frames.push_back({ name, EventClock::now(), recorded });
+    return recorded;
+  }
+  return true;
+}
+
+// The marker after a pass also runs when the gate of the pass was false, and
+// then no frame was started. Its End is kept if the pass would be recorded.
+static auto finish_pass_frame(const std::string &name, bool list) -> bool
+{
+  for (auto it = pass_frames.rbegin(); it != pass_frames.rend(); ++it) {
+    if (it->name == name) {
+      auto recorded = it->recorded;
+      auto duration = std::chrono::duration<double, std::milli>(EventClock::now() - it->start).count();
+      auto &aggregate = pass_aggregates[name];
+      aggregate.count += 1;
+      aggregate.total += duration;
+      if (recorded) {
+        aggregate.recorded_count += 1;
+        aggregate.recorded_total += duration;
+        aggregate.recorded_total_sq += duration * duration;
+      }
+      pass_frames.erase(std::prev(it.base()), pass_frames.end());
+      return recorded;
+    }
+  }
+  return pass_recorded(list);
+}
+
+static auto sampling_summary() -> std::string
+{
+  auto sampled = std::count_if(sampled_functions.cbegin(), sampled_functions.cend(),
+    [](const std::pair<const unsigned int, bool> &entry) { return entry.second; });
+
+  char buffer[256];
+  std::string json;
+  std::snprintf(buffer, sizeof(buffer), "{\"rate\":%lu,\"functions\":%zu,\"sampled_functions\":%ld,\"passes\":{",
+    sample_rate, sampled_functions.size(), static_cast<long>(sampled));
+  json += buffer;
+
+  for (auto it = pass_aggregates.cbegin(); it != pass_aggregates.cend(); ++it) {
+    // Scale the mean of the sampled runs to all runs. The error bound is the
+    // 95% confidence interval with the finite population correction applied.
+    const auto &aggregate = it->second;
+    auto n = static_cast<double>(aggregate.recorded_count);
+    auto total = static_cast<double>(aggregate.count);
+    auto mean = n > 0 ? aggregate.recorded_total / n : 0.0;
+    auto variance = n > 1 ? std::max(0.0, (aggregate.recorded_total_sq - n * mean * mean) / (n - 1)) : 0.0;
+    auto error = n > 0 ? 1.96 * total * std::sqrt(variance / n * (1 - n / total)) : 0.0;
+
+    std::snprintf(buffer, sizeof(buffer),
+      "%s\"%s\":{\"count\":%ld,\"sampled_count\":%ld,\"time_ms\":%.3f,\"estimated_time_ms\":%.3f,\"error_ms\":%.3f}",
+      it == pass_aggregates.cbegin() ? "" : ",", it->first.c_str(), aggregate.count, aggregate.recorded_count,
+      aggregate.total, mean * total, error);
+    json += buffer;
+  }
+  json += "}}";
+  return json;
+}
+
+static auto degradation_name(Degradation level) -> const char *
+{
+  switch (level) {
+  case Degradation::None:
+    return "none";
+  case Degradation::FunctionPasses:
+    return "function_passes";
+  case Degradation::Includes:
+    return "includes";
+  case Degradation::PassLists:
+    return "pass_lists";
+  case Degradation::Exhausted:
+    return "exhausted";
+  }
+  return "";
+}
+
+static auto degradation_summary(EventTimePoint epoch) -> std::string
+{
+  char buffer[256];
+  std::string json;
+  std::snprintf(buffer, sizeof(buffer),
+    "{\"max_events\":%lu,\"max_output_bytes\":%lu,\"events\":%lu,\"estimated_bytes\":%lu,\"level\":\"%s\","
+    "\"include_depth\":%u,\"steps\":[",
+    trace_budget.max_events, trace_budget.max_bytes, trace_budget.events, trace_budget.bytes,
+    degradation_name(trace_budget.level), collapsed_include_depth);
+  json += buffer;
+
+  for (auto it = trace_budget.steps.cbegin(); it != trace_budget.steps.cend(); ++it) {
+    auto ts = std::chrono::duration<double, std::milli>(it->timestamp - epoch).count();
+    std::snprintf(buffer, sizeof(buffer), "%s{\"level\":\"%s\",\"events\":%lu,\"estimated_bytes\":%lu,\"ts_ms\":%.3f}",
+      it == trace_budget.steps.cbegin() ? "" : ",", degradation_name(it->level), it->events, it->bytes, ts);
+    json += buffer;
+  }
+
+  std::snprintf(buffer, sizeof(buffer), "],\"dropped\":{\"includes\":%lu,\"parses\":%lu,\"records\":%lu,\"passes\":{",
+    trace_budget.dropped_includes, trace_budget.dropped_parses, trace_budget.dropped_records);
+  json += buffer;
+
+  auto first = true;
+  for (const auto &entry : pass_aggregates) {
+    const auto &aggregate = entry.second;
+    if (aggregate.count > aggregate.recorded_count) {
+      std::snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"count\":%ld,\"time_ms\":%.3f}", first ? "" : ",",
+        entry.first.c_str(), aggregate.count - aggregate.recorded_count, aggregate.total - aggregate.recorded_total);
+      json += buffer;
+      first = false;
+    }
+  }
+  json += "}}}";
+  return json;
+}
+
+static auto append_json_string(std::string &json, const char *str) -> void
+{
+  escape_json_string(str, std::strlen(str), [&](const char *data, std::size_t len) { json.append(data, len); });
+}
+
+static auto configured_target() -> std::string
+{
+  for (auto option : { "--target=", "--host=", "--build=" }) {
+    if (auto arg = std::strstr(::gcc_version.configuration_arguments, option)) {
+      arg += std::strlen(option);
+      return { arg, std::strcspn(arg, " ") };
+    }
+  }
+  return "unknown";
+}
+
+static auto optimization_level() -> std::string
+{
+  if (optimize_fast) {
+    return "-Ofast";
+  } else if (optimize_debug) {
+    return "-Og";
+  } else if (optimize_size) {
+    return optimize_size > 1 ? "-Oz" : "-Os";
+  }
+  return "-O" + std::to_string(optimize);
+}
+
+// Options that differ between translation units of the same build are left
+// out, so that the hash identifies the configuration rather than the file.
+static auto command_line_hash() -> std::uint64_t
+{
+  auto hash = fnv_offset_basis;
+  for (unsigned int i = 1; i < save_decoded_options_count; ++i) {
+    const auto &option = save_decoded_options[i];
+    switch (option.opt_index) {
+    case OPT_SPECIAL_input_file:
+    case OPT_o:
+    case OPT_dumpbase:
+#if GCCPLUGIN_VERSION_MAJOR >= 11
+    case OPT_dumpbase_ext:
+    case OPT_dumpdir:
+#else
+    case OPT_auxbase:
+    case OPT_auxbase_strip:
+#endif
+    case OPT_MD:
+    case OPT_MMD:
+    case OPT_MF:
+    case OPT_MQ:
+    case OPT_MT:
+      continue;
+    default:
+      break;
+    }
+    if (auto text = option.orig_option_with_args_text) {
+      hash = fnv_hash(hash, text, std::strlen(text));
+    }
+    hash = fnv_hash(hash, "\n", 1);
+  }
+  return hash;
+}
+
+static auto compile_context() -> std::string
+{
+  std::string json = "{\"gcc_version\":";
+  append_json_string(json, ::gcc_version.basever);
+  json += ",\"target\":";
+  append_json_string(json, configured_target().c_str());
+  json += ",\"optimize\":\"" + optimization_level() + "\"";
+
+  const struct
+  {
+    const char *name;
+    bool enabled;
+  } flags[] = {
+    { "pic", flag_pic != 0 },
+    { "pie", flag_pie != 0 },
+    { "exceptions", flag_exceptions != 0 },
+    { "lto", flag_lto != nullptr },
+    { "strict_aliasing", flag_strict_aliasing != 0 },
+    { "omit_frame_pointer", flag_omit_frame_pointer != 0 },
+    { "unroll_loops", flag_unroll_loops != 0 },
+    { "tree_loop_vectorize", flag_tree_loop_vectorize != 0 },
+    { "profile_use", flag_profile_use != 0 },
+    { "sanitize", flag_sanitize != 0 },
+    { "debug", debug_info_level != DINFO_LEVEL_NONE },
+  };
+  json += ",\"flags\":{";
+  for (const auto &flag : flags) {
+    json += &flag == flags ? "\"" : ",\"";
+    json += flag.name;
+    json += flag.enabled ? "\":true" : "\":false";
+  }
+  json += "},\"input\":";
+  append_json_string(json, main_input_filename ? main_input_filename : "");
+
+  char hash[32];
+  std::snprintf(hash, sizeof(hash), ",\"command_line_hash\":\"%016llx\"}",
+    static_cast<unsigned long long>(command_line_hash()));
+  json += hash;
+  return json;
+}
+
+static auto inlined_to(cgraph_node *node) -> cgraph_node *
+{
+#if GCCPLUGIN_VERSION_MAJOR >= 10
+  return node->inlined_to;
+#else
+  return node->global.inlined_to;
+#endif
+}
+
+static auto inline_size(cgraph_node *node, bool self) -> int
+{
+#if GCCPLUGIN_VERSION_MAJOR >= 10
+  auto summary = ::ipa_size_summaries ? ::ipa_size_summaries->get(node) : nullptr;
+  return summary ? (self ? summary->self_size : summary->size) : 0;
+#elif GCCPLUGIN_VERSION_MAJOR >= 8
+  if (not ::ipa_fn_summaries or not ::ipa_fn_summaries->exists(node)) {
+    return 0;
+  }
+  auto summary = ::ipa_fn_summaries->get(node);
+  return self ? summary->self_size : summary->size;
+#else
+  return 0;
+#endif
+}
+
+static auto collect_inline_callees(cgraph_node *node, std::vector<InlineCallee> &callees) -> void
+{
+  for (auto edge = node->callees; edge; edge = edge->next_callee) {
+    if (not edge->inline_failed) {
+      auto decl = edge->callee->decl;
+      callees.push_back({ decl, DECL_PT_UID(decl), inline_size(edge->callee, true) });
+      collect_inline_callees(edge->callee, callees);
+    }
+  }
+}
+
+static auto record_inline_callees(const std::string &pass, cgraph_node *node,
+  std::vector<InlineCallee> callees = {}) -> void
+{
+  collect_inline_callees(node, callees);
+  if (not callees.empty()) {
+    if (degraded(Degradation::PassLists)) {
+      ++trace_budget.dropped_records;
+      return;
+    }
+
+    auto decl = node->decl;
+    charge_event(pass.size() + 64 * callees.size());
+    trace_inline.push({ { pass, decl, DECL_PT_UID(decl), inline_size(node, false), std::move(callees) } });
+  }
+}
+
+// The early inliner applies its decisions right away and removes the inline
+// clones, so they are collected when they are removed.
+static auto inline_removal_hook(cgraph_node *node, void *) -> void
+{
+  if (early_inline_caller and inlined_to(node) == early_inline_caller) {
+    auto decl = node->decl;
+    early_inlined.push_back({ decl, DECL_PT_UID(decl), inline_size(node, true) });
+  }
+}
+
+static auto inline_pass_callback(const std::string &pass) -> void
+{
+  if (pass == "einline") {
+    if (early_inline_caller) {
+      record_inline_callees(pass, early_inline_caller, std::move(early_inlined));
+    }
+    early_inline_caller = nullptr;
+    early_inlined.clear();
+  } else if (pass == "inline") {
+    cgraph_node *node;
+    FOR_EACH_DEFINED_FUNCTION(node) {
+      if (not inlined_to(node)) {
+        record_inline_callees(pass, node);
+      }
+    }
+  }
+}
+
+static auto function_ir_size(function *fn) -> long
+{
+  if (not fn or not fn->cfg) {
+    return 0;
+  }
+
+  long size = 0;
+  basic_block bb;
+  if (fn->curr_properties & PROP_rtl) {
+    FOR_EACH_BB_FN(bb, fn) {
+      rtx_insn *insn;
+      FOR_BB_INSNS(bb, insn) {
+        if (NONDEBUG_INSN_P(insn)) {
+          ++size;
+        }
+      }
+    }
+  } else {
+    FOR_EACH_BB_FN(bb, fn) {
+      for (auto gsi = gsi_start_bb(bb); not gsi_end_p(gsi); gsi_next(&gsi)) {
+        if (not is_gimple_debug(gsi_stmt(gsi))) {
+          ++size;
+        }
+      }
+    }
+  }
+  return size;
+}
+
+// expand_all_functions clears process before expanding a function, so the
+// function being expanded is counted through current_function_decl.
+static auto count_pending_functions() -> long
+{
+  long count = 0;
+  cgraph_node *node;
+  FOR_EACH_DEFINED_FUNCTION(node) {
+    if (not inlined_to(node)
+      and (not expansion_started or node->process or node->decl == ::current_function_decl)) {
+      ++count;
+    }
+  }
+  return count;
+}
 
-std::forward_list<EventRecord<UnitEvent>> trace_unit;
-std::forward_list<EventRecord<IncludeEvent>> trace_include;
-std::forward_list<EventRecord<ParseEvent>> trace_parse;
-std::forward_list<EventRecord<PassEvent>> trace_pass;
+static auto sample_counters(const std::string &list, bool end) -> void
+{
+  if (::current_function_decl and ::cfun) {
+    auto expanded = end and list == "all_passes";
+    auto &size = ir_sizes[DECL_PT_UID(::current_function_decl)];
+    auto new_size = expanded ? 0 : function_ir_size(::cfun);
+    ir_size_total += new_size - size;
+    size = new_size;
+
+    if (list == "all_passes" and not expansion_started) {
+      expansion_started = true;
+      pending_functions = count_pending_functions();
+    }
+    if (expanded and pending_functions > 0) {
+      --pending_functions;
+    }
+  } else if (not expansion_started) {
+    pending_functions = count_pending_functions();
+  }
+
+  if (degraded(Degradation::PassLists)) {
+    ++trace_budget.dropped_records;
+    return;
+  }
+
+  charge_event(64);
+  trace_counter.push({ { ::symtab->cgraph_count, pending_functions, ir_size_total } });
+}
+
+#if GCCPLUGIN_VERSION_MAJOR >= 11
+static auto record_module(ModuleEventKind kind, const char *module, std::string file, long bytes,
+  EventTimePoint start, EventTimePoint end) -> void
+{
+  if (degraded(Degradation::PassLists)) {
+    ++trace_budget.dropped_records;
+    return;
+  }
+
+  charge_event(std::strlen(module) + file.size() + 32);
+  trace_module.push({ { kind, module, std::move(file), bytes, end - start }, start });
+}
+
+// Path of the BMI of a module or header unit as laid out by the default
+// module mapper.
+static auto module_bmi_path(const char *module) -> std::string
+{
+  std::string path = "gcm.cache/";
+  if (module[0] == '/') {
+    path += '.';
+    path += module;
+  } else if (module[0] == '.' and module[1] == '/') {
+    path += ',';
+    path += module + 1;
+  } else {
+    for (auto c = module; *c; ++c) {
+      path += *c == ':' ? '-' : *c;
+    }
+  }
+  return path + ".gcm";
+}
+
+// module_name() only exists in the C++ front end, so it is looked up at run
+// time to keep the plugin loadable into the other front ends.
+static auto primary_module_name() -> const char *
+{
+  using ModuleName = const char *(*)(unsigned int, bool);
+  static auto module_name = reinterpret_cast<ModuleName>(::dlsym(RTLD_DEFAULT, "_Z11module_namejb"));
+  return module_name ? module_name(0, true) : nullptr;
+}
+
+// Plugins are not told about module imports. The line maps that GCC creates
+// for imported modules are picked up at the next callback instead.
+static auto scan_module_imports() -> void
+{
+  if (not flag_modules) {
+    return;
+  }
+
+  auto now = EventClock::now();
+  for (auto used = LINEMAPS_ORDINARY_USED(line_table); scanned_line_maps < used; ++scanned_line_maps) {
+    auto map = LINEMAPS_ORDINARY_MAP_AT(line_table, scanned_line_maps);
+    if (map->reason != LC_MODULE) {
+      continue;
+    }
+    auto module = ORDINARY_MAP_FILE_NAME(map);
+    auto primary = primary_module_name();
+    if (primary and std::strcmp(module, primary) == 0) {
+      continue;
+    }
+    auto bmi = module_bmi_path(module);
+    auto bytes = dump_file_size(bmi);
+    record_module(ModuleEventKind::Import, module, std::move(bmi), bytes > 0 ? bytes : -1, now, now);
+  }
+}
+
+// The BMI of the unit is written to a temporary file that is renamed once
+// complete, so its birth and modification times bound the write.
+static auto record_module_write() -> void
+{
+  auto module = flag_modules ? primary_module_name() : nullptr;
+  if (not module) {
+    return;
+  }
+
+  auto bmi = module_bmi_path(module);
+  auto offset = std::chrono::duration_cast<std::chrono::nanoseconds>(EventClock::now().time_since_epoch())
+    - std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch());
+  auto event_time = [&](long long sec, long long nsec) {
+    return EventTimePoint { std::chrono::duration_cast<EventDuration>(
+      std::chrono::seconds { sec } + std::chrono::nanoseconds { nsec } + offset) };
+  };
+#ifdef STATX_BTIME
+  struct statx st;
+  if (::statx(AT_FDCWD, bmi.c_str(), 0, STATX_SIZE | STATX_MTIME | STATX_BTIME, &st) != 0) {
+    return;
+  }
+  auto end = event_time(st.stx_mtime.tv_sec, st.stx_mtime.tv_nsec);
+  auto start = st.stx_mask & STATX_BTIME ? event_time(st.stx_btime.tv_sec, st.stx_btime.tv_nsec) : end;
+  long bytes = st.stx_size;
+#else
+  struct stat st;
+  if (::stat(bmi.c_str(), &st) != 0) {
+    return;
+  }
+  auto end = event_time(st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+  auto start = end;
+  long bytes = st.st_size;
+#endif
+  auto unit_start = trace_unit.first_timestamp();
+  if (end < unit_start) {
+    return;
+  }
+  record_module(ModuleEventKind::Write, module, std::move(bmi), bytes, std::max(start, unit_start), end);
+}
+
+static auto include_path(const char *path) -> const char *
+{
+  return path;
+}
+
+static auto include_path(_cpp_file *file) -> const char *
+{
+  return cpp_get_path(file);
+}
+
+// Times the module mapper queries on whether an include is translated into
+// the import of a header unit. The callback gained parameters in GCC 13.
+template <typename Callback>
+struct TranslateInclude;
+
+template <typename File, typename... Rest>
+struct TranslateInclude<char *(*)(cpp_reader *, line_maps *, location_t, File, Rest...)>
+{
+  using Callback = char *(*)(cpp_reader *, line_maps *, location_t, File, Rest...);
+
+  static auto old() -> Callback &
+  {
+    static Callback callback;
+    return callback;
+  }
+
+  static auto translate(cpp_reader *reader, line_maps *maps, location_t loc, File file, Rest... rest) -> char *
+  {
+    auto start = EventClock::now();
+    auto result = old()(reader, maps, loc, file, rest...);
+    auto path = include_path(file);
+    record_module(ModuleEventKind::Translate, result ? path : "", path, -1, start, EventClock::now());
+    return result;
+  }
+};
+
+using TranslateIncludeHook = TranslateInclude<decltype(cpp_callbacks::translate_include)>;
+#endif
 
 static auto cb_file_change(cpp_reader *parse_in, const line_map_ordinary *line_map) -> void
 {
+#if GCCPLUGIN_VERSION_MAJOR >= 11
+  scan_module_imports();
+#endif
   if (line_map) {
     if (line_map->reason == LC_ENTER) {
-      trace_include.push_front(IncludeEvent { IncludeEventKind::Enter, ORDINARY_MAP_FILE_NAME(line_map) });
+      auto recorded = not degraded(Degradation::Includes)
+        or (not degraded(Degradation::PassLists) and include_depth < collapsed_include_depth);
+      if (recorded) {
+        auto filename = ORDINARY_MAP_FILE_NAME(line_map);
+        charge_event(std::strlen(filename));
+        trace_include.push(IncludeEvent { IncludeEventKind::Enter, filename, include_depth });
+      } else {
+        ++trace_budget.dropped_includes;
+      }
+      include_recorded.push_back(recorded);
+      ++include_depth;
     } else if (line_map->reason == LC_LEAVE) {
-      trace_include.push_front(IncludeEvent { IncludeEventKind::Leave });
+      include_depth = include_depth > 0 ? include_depth - 1 : 0;
+      auto recorded = include_recorded.empty() or include_recorded.back();
+      if (not include_recorded.empty()) {
+        include_recorded.pop_back();
+      }
+      if (recorded) {
+        charge_event(0);
+        trace_include.push(IncludeEvent { IncludeEventKind::Leave, {}, include_depth });
+      }
     }
   }
   if (old_cb_file_change) {
@@ -94,50 +909,118 @@ static auto start_unit_callback(void *, void *) -> void
   auto cb = cpp_get_callbacks(parse_in);
   old_cb_file_change = cb->file_change;
   cb->file_change = &cb_file_change;
-  trace_unit.push_front({ { UnitEventKind::Start } });
+  if (inline_callees) {
+    // Registered before the summaries are created, so that the hook runs
+    // while the summaries of removed clones still exist.
+    ::symtab->add_cgraph_removal_hook(&inline_removal_hook, nullptr);
+  }
+#if GCCPLUGIN_VERSION_MAJOR >= 11
+  if (cb->translate_include) {
+    TranslateIncludeHook::old() = cb->translate_include;
+    cb->translate_include = &TranslateIncludeHook::translate;
+  }
+#endif
+  charge_event(0);
+  trace_unit.push({ { UnitEventKind::Start } });
 }
 
 static auto finish_unit_callback(void *, void *) -> void
 {
-  trace_unit.push_front({ { UnitEventKind::End } });
+#if GCCPLUGIN_VERSION_MAJOR >= 11
+  scan_module_imports();
+  record_module_write();
+#endif
+  charge_event(0);
+  trace_unit.push({ { UnitEventKind::End } });
+}
+
+static auto parse_recorded(unsigned int uid, bool finish) -> bool
+{
+  auto it = std::find(open_parses.begin(), open_parses.end(), uid);
+  auto recorded = it != open_parses.end() or not degraded(Degradation::PassLists);
+  if (finish and it != open_parses.end()) {
+    open_parses.erase(it);
+  }
+  if (not recorded) {
+    ++trace_budget.dropped_parses;
+  }
+  return recorded;
 }
 
 static auto start_parse_function_callback(void *event_data, void *) -> void
 {
+#if GCCPLUGIN_VERSION_MAJOR >= 11
+  scan_module_imports();
+#endif
   auto fndecl = static_cast<tree>(event_data);
-  trace_parse.push_front({ { ParseEventKind::Start, fndecl, DECL_PT_UID(fndecl) } });
+  auto uid = DECL_PT_UID(fndecl);
+  if (budget_enabled()) {
+    if (degraded(Degradation::PassLists)) {
+      ++trace_budget.dropped_parses;
+      return;
+    }
+    open_parses.push_back(uid);
+  }
+  charge_event(32);
+  trace_parse.push({ { ParseEventKind::Start, fndecl, uid } });
 }
 
 static auto pre_genericize_callback(void *event_data, void *) -> void
 {
   auto fndecl = static_cast<tree>(event_data);
-  trace_parse.push_front({ { ParseEventKind::PreGenericize, fndecl, DECL_PT_UID(fndecl) } });
+  auto uid = DECL_PT_UID(fndecl);
+  if (budget_enabled() and not parse_recorded(uid, false)) {
+    return;
+  }
+  charge_event(32);
+  trace_parse.push({ { ParseEventKind::PreGenericize, fndecl, uid } });
 }
 
 static auto finish_parse_function_callback(void *event_data, void *) -> void
 {
   auto fndecl = static_cast<tree>(event_data);
-  trace_parse.push_front({ { ParseEventKind::Finish, fndecl, DECL_PT_UID(fndecl) } });
+  auto uid = DECL_PT_UID(fndecl);
+  if (budget_enabled() and not parse_recorded(uid, true)) {
+    return;
+  }
+  charge_event(32);
+  trace_parse.push({ { ParseEventKind::Finish, fndecl, uid } });
 }
 
 static auto early_gimple_passes_start_callback(void *, void *) -> void
 {
-  trace_pass.push_front({ { PassEventKind::Start, "early_gimple_passes" } });
+  charge_event(19);
+  trace_pass.push({ { PassEventKind::Start, "early_gimple_passes" } });
+  if (counters) {
+    sample_counters("early_gimple_passes", false);
+  }
 }
 
 static auto early_gimple_passes_end_callback(void *, void *) -> void
 {
-  trace_pass.push_front({ { PassEventKind::End, "early_gimple_passes" } });
+  charge_event(19);
+  trace_pass.push({ { PassEventKind::End, "early_gimple_passes" } });
+  if (counters) {
+    sample_counters("early_gimple_passes", true);
+  }
 }
 
 static auto all_ipa_passes_start_callback(void *, void *) -> void
 {
-  trace_pass.push_front({ { PassEventKind::Start, "all_ipa_passes" } });
+  charge_event(14);
+  trace_pass.push({ { PassEventKind::Start, "all_ipa_passes" } });
+  if (counters) {
+    sample_counters("all_ipa_passes", false);
+  }
 }
 
 static auto all_ipa_passes_end_callback(void *, void *) -> void
 {
-  trace_pass.push_front({ { PassEventKind::End, "all_ipa_passes" } });
+  charge_event(14);
+  trace_pass.push({ { PassEventKind::End, "all_ipa_passes" } });
+  if (counters) {
+    sample_counters("all_ipa_passes", true);
+  }
 }
 
 static auto override_gate_callback(void *, void *) -> void
@@ -146,16 +1029,37 @@ static auto override_gate_callback(void *, void *) -> void
     auto pass = static_cast<TimeTracePass *>(::current_pass);
     auto uid = ::current_function_decl ? DECL_PT_UID(::current_function_decl) : -1u;
     switch (pass->trace_kind) {
-    case TimeTracePassKind::Single:
-      trace_pass.push_front({ { PassEventKind::End, pass->trace_name, NULL_TREE, -1u } });
+    case TimeTracePassKind::Single: {
+      PassEvent event { PassEventKind::End, pass->trace_name, NULL_TREE, -1u };
+      finish_dump_probe(event);
+      if (finish_pass_frame(pass->trace_name, false)) {
+        charge_event(pass->trace_name.size());
+        trace_pass.push({ std::move(event) });
+      }
+      if (inline_callees) {
+        inline_pass_callback(pass->trace_name);
+      }
       break;
+    }
 
     case TimeTracePassKind::StartList:
-      trace_pass.push_front({ { PassEventKind::Start, pass->trace_name, ::current_function_decl, uid } });
+      if (start_pass_frame(pass->trace_name, true)) {
+        charge_event(pass->trace_name.size() + 32);
+        trace_pass.push({ { PassEventKind::Start, pass->trace_name, ::current_function_decl, uid } });
+      }
+      if (counters) {
+        sample_counters(pass->trace_name, false);
+      }
       break;
 
     case TimeTracePassKind::EndList:
-      trace_pass.push_front({ { PassEventKind::End, pass->trace_name, ::current_function_decl, uid } });
+      if (finish_pass_frame(pass->trace_name, true)) {
+        charge_event(pass->trace_name.size() + 32);
+        trace_pass.push({ { PassEventKind::End, pass->trace_name, ::current_function_decl, uid } });
+      }
+      if (counters) {
+        sample_counters(pass->trace_name, true);
+      }
       break;
     }
   }
@@ -164,61 +1068,166 @@ static auto override_gate_callback(void *, void *) -> void
 static auto pass_execution_callback(void *event_data, void *) -> void
 {
   auto pass = static_cast<opt_pass *>(event_data);
-  trace_pass.push_front({ { PassEventKind::Start, pass->name, NULL_TREE, -1u } });
+  if (start_pass_frame(pass->name, false)) {
+    PassEvent event { PassEventKind::Start, pass->name, NULL_TREE, -1u };
+    if (pass_ir_size and ::current_function_decl and ::cfun) {
+      event.decl = ::current_function_decl;
+      event.uid = DECL_PT_UID(::current_function_decl);
+      event.ir_size = function_ir_size(::cfun);
+    }
+    charge_event(std::strlen(pass->name));
+    trace_pass.push({ std::move(event) });
+  }
+  start_dump_probe(pass);
+  if (inline_callees and std::strcmp(pass->name, "einline") == 0 and ::current_function_decl) {
+    early_inline_caller = cgraph_node::get(::current_function_decl);
+    early_inlined.clear();
+  }
 }
 
 static auto finish_callback(void *, void *) -> void
 {
   auto dump_start = EventClock::now();
 
-  trace_unit.reverse();
-  trace_include.reverse();
-  trace_parse.reverse();
-  trace_pass.reverse();
-
   auto epoch = std::min({
-    trace_unit.empty() ? EventTimePoint::max() : trace_unit.front().timestamp,
-    trace_include.empty() ? EventTimePoint::max() : trace_include.front().timestamp,
-    trace_parse.empty() ? EventTimePoint::max() : trace_parse.front().timestamp,
-    trace_pass.empty() ? EventTimePoint::max() : trace_pass.front().timestamp,
+    trace_unit.first_timestamp(),
+    trace_include.first_timestamp(),
+    trace_parse.first_timestamp(),
+    trace_pass.first_timestamp(),
+    trace_inline.first_timestamp(),
+    trace_counter.first_timestamp(),
+    trace_module.first_timestamp(),
   });
 
   struct File
   {
-    FILE *file;
-    ~File() { ::fclose(file); }
+    Output output;
+    bool open;
+    std::string filename;
+
+    File(const char *suffix, bool enabled)
+      : open(false)
+    {
+      if (enabled) {
+        filename += dump_base_name;
+        filename += suffix;
+        open = output.open(filename.c_str(), output_mode);
+        if (not open) {
+          errno = output.error();
+          warning(0, "cannot open time trace file %qs: %m", filename.c_str());
+        }
+      }
+    }
+
+    // Runs after the writers using the output are destroyed.
+    ~File()
+    {
+      if (open and not output.close()) {
+        errno = output.error();
+        warning(0, "failed to write time trace file %qs: %m", filename.c_str());
+      }
+    }
   };
 
-  std::string filename;
-  filename += dump_base_name;
-  filename += ".trace.json";
-  File guard { ::fopen(filename.c_str(), "wb") };
-  TraceWriter writer { guard.file, epoch, decl_verbosity };
-  WriteCallback cb { writer };
+  NameTable names;
+  File json_file { ".trace.json", output_json };
+  File summary_file { ".trace.summary.json", output_summary };
+  File folded_file { ".trace.folded", output_folded };
+  File columnar_file { ".trace.columnar", output_columnar };
+  File scope_table_file { ".trace.scopes.txt", scopes };
+  File scope_folded_file { ".trace.scopes.folded", scopes };
+  std::unique_ptr<TraceWriter> json { json_file.open ? new TraceWriter { json_file.output, names, epoch } : nullptr };
+  std::unique_ptr<SummaryWriter> summary {
+    summary_file.open ? new SummaryWriter { summary_file.output, names } : nullptr
+  };
+  std::unique_ptr<FoldedWriter> folded { folded_file.open ? new FoldedWriter { folded_file.output, names } : nullptr };
+  std::unique_ptr<ColumnarWriter> columns {
+    columnar_file.open ? new ColumnarWriter { columnar_file.output, names, epoch } : nullptr
+  };
+  std::unique_ptr<ScopeWriter> scope {
+    scopes ? new ScopeWriter { scope_table_file.open ? &scope_table_file.output : nullptr,
+               scope_folded_file.open ? &scope_folded_file.output : nullptr, names }
+           : nullptr
+  };
 
-  EventTracker<WriteCallback> tracker { cb };
-  for (auto &event : trace_unit) {
-    tracker.push_event(event);
-  }
-  for (auto &event : trace_include) {
-    tracker.push_event(event);
+  using Sinks = SinkSet<TraceWriter, SummaryWriter, FoldedWriter, ColumnarWriter, ScopeWriter>;
+  Sinks sinks { json.get(), summary.get(), folded.get(), columns.get(), scope.get() };
+  SliceDispatcher<Sinks> dispatcher { sinks, names, decl_verbosity, scopes };
+
+  EventTracker<SliceDispatcher<Sinks>> tracker { dispatcher };
+  trace_unit.for_each([&](EventRecord<UnitEvent> &event) { tracker.push_event(event); });
+  trace_include.for_each([&](EventRecord<IncludeEvent> &event) { tracker.push_event(event); });
+  trace_parse.for_each([&](EventRecord<ParseEvent> &event) { tracker.push_event(event); });
+  trace_pass.for_each([&](EventRecord<PassEvent> &event) { tracker.push_event(event); });
+  tracker.finish();
+  trace_inline.for_each([&](EventRecord<InlineEvent> &event) { dispatcher.write_inline(event); });
+  trace_counter.for_each([&](EventRecord<CounterEvent> &event) { dispatcher.write_counter(event); });
+  trace_module.for_each([&](EventRecord<ModuleEvent> &event) { dispatcher.write_module(event); });
+  if (memory_budget.spill_error) {
+    errno = memory_budget.spill_error;
+    warning(0, "cannot spill trace events to a temporary file: %m");
   }
-  for (auto &event : trace_parse) {
-    tracker.push_event(event);
+
+  sinks.write_metadata("compile", compile_context());
+  if (sample_rate > 1) {
+    sinks.write_metadata("sampling", sampling_summary());
   }
-  for (auto &event : trace_pass) {
-    tracker.push_event(event);
+  if (budget_enabled()) {
+    sinks.write_metadata("degradation", degradation_summary(epoch));
   }
-  tracker.finish();
 
   auto dump_end = EventClock::now();
-  writer.write_slice("plugin_dump", dump_start, dump_end);
+  dispatcher.write_slice("plugin_dump", dump_start, dump_end);
+}
+
+static auto setup_format(plugin_name_args *args, const char *value) -> bool
+{
+  output_json = false;
+  output_summary = false;
+  output_folded = false;
+  output_columnar = false;
+  for (;;) {
+    auto len = std::strcspn(value, ",");
+    if (len == 4 and std::strncmp(value, "json", len) == 0) {
+      output_json = true;
+    } else if (len == 7 and std::strncmp(value, "summary", len) == 0) {
+      output_summary = true;
+    } else if (len == 6 and std::strncmp(value, "folded", len) == 0) {
+      output_folded = true;
+    } else if (len == 8 and std::strncmp(value, "columnar", len) == 0) {
+      output_columnar = true;
+    } else {
+      error("argument of %<-fplugin-arg-%s-format%> must be a comma separated list of json, summary, folded, "
+            "or columnar",
+        args->base_name);
+      return false;
+    }
+    if (not value[len]) {
+      return true;
+    }
+    value += len + 1;
+  }
 }
 
 static auto setup_option(plugin_name_args *args) -> bool
 {
   decl_verbosity = 1;
   version_check = true;
+  inline_callees = false;
+  counters = false;
+  pass_ir_size = false;
+  scopes = false;
+  sample_rate = 1;
+  select_globs.clear();
+  select_rate = 1;
+  memory_budget.limit = 0;
+  trace_budget.max_events = 0;
+  trace_budget.max_bytes = 0;
+  output_json = true;
+  output_summary = false;
+  output_folded = false;
+  output_columnar = false;
+  output_mode = OutputMode::Buffered;
   for (auto i = 0; i < args->argc; ++i) {
     if (std::strcmp(args->argv[i].key, "verbose-decl") == 0) {
       if (not args->argv[i].value) {
@@ -243,6 +1252,127 @@ static auto setup_option(plugin_name_args *args) -> bool
       }
 
       version_check = false;
+    } else if (std::strcmp(args->argv[i].key, "inline-callees") == 0) {
+      if (args->argv[i].value) {
+        error("unexpected argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      inline_callees = true;
+    } else if (std::strcmp(args->argv[i].key, "counters") == 0) {
+      if (args->argv[i].value) {
+        error("unexpected argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      counters = true;
+    } else if (std::strcmp(args->argv[i].key, "ir-size") == 0) {
+      if (args->argv[i].value) {
+        error("unexpected argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      pass_ir_size = true;
+    } else if (std::strcmp(args->argv[i].key, "scopes") == 0) {
+      if (args->argv[i].value) {
+        error("unexpected argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      scopes = true;
+    } else if (std::strcmp(args->argv[i].key, "max-memory") == 0) {
+      if (not args->argv[i].value) {
+        error("missing argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      char *end;
+      auto megabytes = std::strtoul(args->argv[i].value, &end, 10);
+      if (*end or megabytes == 0) {
+        error("argument of %<-fplugin-arg-%s-%s%> must be a positive integer", args->base_name, args->argv[i].key);
+        return false;
+      }
+      memory_budget.limit = megabytes << 20;
+    } else if (std::strcmp(args->argv[i].key, "max-events") == 0) {
+      if (not args->argv[i].value) {
+        error("missing argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      char *end;
+      auto events = std::strtoul(args->argv[i].value, &end, 10);
+      if (*end or events == 0) {
+        error("argument of %<-fplugin-arg-%s-%s%> must be a positive integer", args->base_name, args->argv[i].key);
+        return false;
+      }
+      trace_budget.max_events = events;
+    } else if (std::strcmp(args->argv[i].key, "max-output-size") == 0) {
+      if (not args->argv[i].value) {
+        error("missing argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      char *end;
+      auto megabytes = std::strtoul(args->argv[i].value, &end, 10);
+      if (*end or megabytes == 0) {
+        error("argument of %<-fplugin-arg-%s-%s%> must be a positive integer", args->base_name, args->argv[i].key);
+        return false;
+      }
+      trace_budget.max_bytes = megabytes << 20;
+    } else if (std::strcmp(args->argv[i].key, "output-mode") == 0) {
+      if (not args->argv[i].value) {
+        error("missing argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      if (std::strcmp(args->argv[i].value, "buffered") == 0) {
+        output_mode = OutputMode::Buffered;
+      } else if (std::strcmp(args->argv[i].value, "mmap") == 0) {
+        output_mode = OutputMode::Mapped;
+      } else {
+        error("argument of %<-fplugin-arg-%s-%s%> must be buffered or mmap", args->base_name, args->argv[i].key);
+        return false;
+      }
+    } else if (std::strcmp(args->argv[i].key, "format") == 0) {
+      if (not args->argv[i].value) {
+        error("missing argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      if (not setup_format(args, args->argv[i].value)) {
+        return false;
+      }
+    } else if (std::strcmp(args->argv[i].key, "sample-functions") == 0) {
+      if (not args->argv[i].value) {
+        error("missing argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      char *end;
+      sample_rate = std::strtoul(args->argv[i].value, &end, 10);
+      if (*end or sample_rate == 0) {
+        error("argument of %<-fplugin-arg-%s-%s%> must be a positive integer", args->base_name, args->argv[i].key);
+        return false;
+      }
+    } else if (std::strcmp(args->argv[i].key, "select") == 0) {
+      if (not args->argv[i].value) {
+        error("missing argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      select_globs.push_back(args->argv[i].value);
+    } else if (std::strcmp(args->argv[i].key, "select-rate") == 0) {
+      if (not args->argv[i].value) {
+        error("missing argument to %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
+        return false;
+      }
+
+      char *end;
+      select_rate = std::strtoul(args->argv[i].value, &end, 10);
+      if (*end or select_rate == 0) {
+        error("argument of %<-fplugin-arg-%s-%s%> must be a positive integer", args->base_name, args->argv[i].key);
+        return false;
+      }
     } else {
       error("unrecoginized timetrace plugin option %<-fplugin-arg-%s-%s%>", args->base_name, args->argv[i].key);
       return false;
@@ -322,14 +1452,16 @@ auto plugin_init(plugin_name_args *args, plugin_gcc_version *version) -> int
   if (not setup_option(args)) {
     return 1;
   }
-
-  setup_time_trace_passes();
-  setup_plugin_callbacks(args->base_name);
-
   if (version_check and not plugin_default_version_check(version, &::gcc_version)) {
     error("plugin %qs is built for a different version of GCC", args->base_name);
     return 1;
   }
+  if (not unit_selected()) {
+    return 0;
+  }
+
+  setup_time_trace_passes();
+  setup_plugin_callbacks(args->base_name);
 
   return 0;
 }
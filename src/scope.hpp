@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "event.hpp"
+#include "names.hpp"
+#include "output.hpp"
+#include "sink.hpp"
+
+// Rolls the time of function slices up into the namespaces and classes that
+// enclose the functions. Nested slices of a function are merged first, so a
+// function is charged for the wall time of each phase once.
+class ScopeWriter
+{
+  enum Phase
+  {
+    Frontend,
+    Genericize,
+    Backend,
+    PhaseCount,
+  };
+
+  struct Interval
+  {
+    EventTimePoint start;
+    EventTimePoint end;
+  };
+
+  struct Function
+  {
+    NameTable::Id scope;
+    std::vector<Interval> phases[PhaseCount];
+  };
+
+  struct Node
+  {
+    std::string name;
+    EventDuration parse;
+    EventDuration genericize;
+    EventDuration backend;
+    long functions;
+    std::map<std::string, std::size_t> children;
+
+    auto total() const -> EventDuration
+    {
+      return parse + genericize + backend;
+    }
+  };
+
+  Output *_table;
+  Output *_folded;
+  const NameTable &_names;
+  std::unordered_map<unsigned int, Function> _functions;
+
+public:
+  ScopeWriter(const ScopeWriter &) = delete;
+  ScopeWriter(ScopeWriter &&) = delete;
+
+  ScopeWriter(Output *table, Output *folded, const NameTable &names)
+    : _table(table)
+    , _folded(folded)
+    , _names(names)
+  {
+  }
+
+  ~ScopeWriter()
+  {
+    std::vector<Node> nodes(1);
+    std::map<std::string, long> stacks;
+    for (const auto &entry : _functions) {
+      const auto &function = entry.second;
+      auto genericize = covered(function.phases[Genericize]);
+      auto parse = covered(function.phases[Frontend]) - genericize;
+      auto backend = covered(function.phases[Backend]);
+
+      std::size_t node = 0;
+      std::string path;
+      auto add = [&]() {
+        nodes[node].parse += parse;
+        nodes[node].genericize += genericize;
+        nodes[node].backend += backend;
+        nodes[node].functions += 1;
+      };
+      add();
+      for (auto scope = _names.str(function.scope); *scope;) {
+        auto end = std::strstr(scope, "::");
+        std::string name { scope, end ? static_cast<std::size_t>(end - scope) : std::strlen(scope) };
+        scope += name.size() + (end ? 2 : 0);
+
+        auto child = nodes[node].children.find(name);
+        if (child != nodes[node].children.end()) {
+          node = child->second;
+        } else {
+          nodes[node].children.emplace(name, nodes.size());
+          node = nodes.size();
+          nodes.emplace_back();
+          nodes.back().name = name;
+        }
+        add();
+        path += path.empty() ? "" : ";";
+        path += name;
+      }
+
+      stacks[path + ";parse"] += std::chrono::duration_cast<std::chrono::microseconds>(parse).count();
+      stacks[path + ";genericize"] += std::chrono::duration_cast<std::chrono::microseconds>(genericize).count();
+      stacks[path + ";backend"] += std::chrono::duration_cast<std::chrono::microseconds>(backend).count();
+    }
+
+    if (_table) {
+      _table->printf("%12s %12s %12s %12s %9s  %s\n", "total (ms)", "parse (ms)", "generic (ms)", "backend (ms)",
+        "functions", "scope");
+      for (const auto &child : sorted_children(nodes, nodes[0])) {
+        write_node(nodes, child, 0);
+      }
+    }
+    if (_folded) {
+      for (const auto &stack : stacks) {
+        if (stack.second > 0) {
+          _folded->printf("%s %ld\n", stack.first.c_str(), stack.second);
+        }
+      }
+    }
+  }
+
+  auto write_metadata(const std::string &, const std::string &) -> void
+  {
+  }
+
+  auto write_slice(const Slice &slice) -> void
+  {
+    if (slice.scope == NameTable::npos or slice.start == slice.end) {
+      return;
+    }
+
+    auto &function = _functions[slice.uid];
+    function.scope = slice.scope;
+    Interval interval { slice.start, slice.end };
+    switch (slice.kind) {
+    case SliceKind::Genericize:
+      merge(function.phases[Genericize], interval);
+      merge(function.phases[Frontend], interval);
+      break;
+    case SliceKind::Parse:
+      merge(function.phases[Frontend], interval);
+      break;
+    case SliceKind::Pass:
+      merge(function.phases[Backend], interval);
+      break;
+    default:
+      break;
+    }
+  }
+
+  auto write_inline(const EventRecord<InlineEvent> &) -> void
+  {
+  }
+
+  auto write_counter(const EventRecord<CounterEvent> &) -> void
+  {
+  }
+
+private:
+  static auto merge(std::vector<Interval> &intervals, Interval interval) -> void
+  {
+    auto first = std::lower_bound(intervals.begin(), intervals.end(), interval.start,
+      [](const Interval &a, EventTimePoint start) { return a.end < start; });
+    auto last = first;
+    for (; last != intervals.end() and last->start <= interval.end; ++last) {
+      interval.start = std::min(interval.start, last->start);
+      interval.end = std::max(interval.end, last->end);
+    }
+    intervals.insert(intervals.erase(first, last), interval);
+  }
+
+  static auto covered(const std::vector<Interval> &intervals) -> EventDuration
+  {
+    auto total = EventDuration::zero();
+    for (const auto &interval : intervals) {
+      total += interval.end - interval.start;
+    }
+    return total;
+  }
+
+  static auto sorted_children(const std::vector<Node> &nodes, const Node &node) -> std::vector<std::size_t>
+  {
+    std::vector<std::size_t> children;
+    for (const auto &child : node.children) {
+      children.push_back(child.second);
+    }
+    std::sort(children.begin(), children.end(),
+      [&](std::size_t a, std::size_t b) { return nodes[a].total() > nodes[b].total(); });
+    return children;
+  }
+
+  auto write_node(const std::vector<Node> &nodes, std::size_t index, int depth) -> void
+  {
+    const auto &node = nodes[index];
+    auto ms = [](EventDuration duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+    _table->printf("%12.3f %12.3f %12.3f %12.3f %9ld  %*s%s\n", ms(node.total()), ms(node.parse),
+      ms(node.genericize), ms(node.backend), node.functions, depth * 2, "", node.name.c_str());
+    for (const auto &child : sorted_children(nodes, node)) {
+      write_node(nodes, child, depth + 1);
+    }
+  }
+};
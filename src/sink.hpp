@@ -0,0 +1,368 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "column.hpp"
+#include "event.hpp"
+#include "names.hpp"
+
+#include <gcc-plugin.h>
+
+#include <coretypes.h>
+#include <langhooks.h>
+#include <tree.h>
+
+enum class SliceKind : unsigned char
+{
+  Unit,
+  Include,
+  Parse,
+  Genericize,
+  Pass,
+  Plugin,
+  Module,
+};
+
+static_assert(static_cast<int>(columnar::Category::Plugin) == static_cast<int>(SliceKind::Plugin),
+  "slice kinds must map onto the leading columnar categories");
+
+inline auto slice_category(SliceKind kind) -> columnar::Category
+{
+  return kind == SliceKind::Module ? columnar::Category::Module : static_cast<columnar::Category>(kind);
+}
+
+struct Slice
+{
+  SliceKind kind;
+  NameTable::Id name;
+  EventTimePoint start;
+  EventTimePoint end;
+  NameTable::Id function;
+  NameTable::Id scope;
+  unsigned int uid;
+  NameTable::Id file;
+  NameTable::Id module;
+  long bytes;
+  unsigned int depth;
+  bool dump;
+  long dump_bytes;
+  long ir_size;
+
+  Slice(SliceKind kind, NameTable::Id name, EventTimePoint start, EventTimePoint end)
+    : kind(kind)
+    , name(name)
+    , start(start)
+    , end(end)
+    , function(NameTable::npos)
+    , scope(NameTable::npos)
+    , uid(-1u)
+    , file(NameTable::npos)
+    , module(NameTable::npos)
+    , bytes(-1)
+    , depth(0)
+    , dump(false)
+    , dump_bytes(0)
+    , ir_size(0)
+  {
+  }
+};
+
+// Fans every operation out to the enabled sinks. Sinks are held by pointer
+// and left null when disabled; the calls are resolved at compile time.
+template <typename... Sinks>
+class SinkSet
+{
+  std::tuple<Sinks *...> _sinks;
+
+  struct WriteSlice
+  {
+    const Slice &slice;
+
+    template <typename S>
+    auto operator()(S &sink) -> void
+    {
+      sink.write_slice(slice);
+    }
+  };
+
+  struct WriteInline
+  {
+    const EventRecord<InlineEvent> &record;
+
+    template <typename S>
+    auto operator()(S &sink) -> void
+    {
+      sink.write_inline(record);
+    }
+  };
+
+  struct WriteCounter
+  {
+    const EventRecord<CounterEvent> &record;
+
+    template <typename S>
+    auto operator()(S &sink) -> void
+    {
+      sink.write_counter(record);
+    }
+  };
+
+  struct WriteMetadata
+  {
+    const std::string &key;
+    const std::string &json;
+
+    template <typename S>
+    auto operator()(S &sink) -> void
+    {
+      sink.write_metadata(key, json);
+    }
+  };
+
+public:
+  SinkSet(Sinks *...sinks)
+    : _sinks(sinks...)
+  {
+  }
+
+  auto write_slice(const Slice &slice) -> void
+  {
+    dispatch<0>(WriteSlice { slice });
+  }
+
+  auto write_inline(const EventRecord<InlineEvent> &record) -> void
+  {
+    dispatch<0>(WriteInline { record });
+  }
+
+  auto write_counter(const EventRecord<CounterEvent> &record) -> void
+  {
+    dispatch<0>(WriteCounter { record });
+  }
+
+  auto write_metadata(const std::string &key, const std::string &json) -> void
+  {
+    dispatch<0>(WriteMetadata { key, json });
+  }
+
+private:
+  template <std::size_t I, typename Op>
+  auto dispatch(Op) -> typename std::enable_if<I == sizeof...(Sinks)>::type
+  {
+  }
+
+  template <std::size_t I, typename Op>
+  auto dispatch(Op op) -> typename std::enable_if<(I < sizeof...(Sinks))>::type
+  {
+    if (auto sink = std::get<I>(_sinks)) {
+      op(*sink);
+    }
+    dispatch<I + 1>(op);
+  }
+};
+
+// Callback of EventTracker. Turns matched and mismatched events into slices,
+// resolving names once, and hands them to the sinks.
+template <typename Sinks>
+class SliceDispatcher
+{
+  Sinks &_sinks;
+  NameTable &_names;
+  int _decl_verbosity;
+  bool _scopes_enabled;
+  UidMap _scopes;
+
+public:
+  SliceDispatcher(Sinks &sinks, NameTable &names, int decl_verbosity, bool scopes)
+    : _sinks(sinks)
+    , _names(names)
+    , _decl_verbosity(decl_verbosity)
+    , _scopes_enabled(scopes)
+  {
+  }
+
+  auto on_match(EventRecord<UnitEvent> start, EventRecord<UnitEvent> end) -> void
+  {
+    _sinks.write_slice({ SliceKind::Unit, _names.intern("unit"), start.timestamp, end.timestamp });
+  }
+
+  auto on_match(EventRecord<IncludeEvent> start, EventRecord<IncludeEvent> end) -> void
+  {
+    Slice slice { SliceKind::Include, _names.intern("include"), start.timestamp, end.timestamp };
+    slice.file = _names.intern(start.event.filename.data(), start.event.filename.size());
+    slice.depth = start.event.depth;
+    _sinks.write_slice(slice);
+  }
+
+  auto on_match(EventRecord<ParseEvent> start, EventRecord<ParseEvent> end) -> void
+  {
+    auto genericize = start.event.kind != ParseEventKind::Start;
+    Slice slice { genericize ? SliceKind::Genericize : SliceKind::Parse,
+      _names.intern(genericize ? "genericize" : "parse"), start.timestamp, end.timestamp };
+    set_function(slice, start.event.decl);
+    _sinks.write_slice(slice);
+  }
+
+  auto on_match(EventRecord<PassEvent> start, EventRecord<PassEvent> end) -> void
+  {
+    Slice slice { SliceKind::Pass, _names.intern(start.event.name.data(), start.event.name.size()), start.timestamp,
+      end.timestamp };
+    set_function(slice, start.event.decl);
+    slice.dump = end.event.dump;
+    slice.dump_bytes = end.event.dump_bytes;
+    slice.ir_size = start.event.ir_size;
+    _sinks.write_slice(slice);
+  }
+
+  auto on_mismatch(EventRecord<UnitEvent> end) -> void
+  {
+    auto name = end.event.kind == UnitEventKind::Start ? "unit (start)" : "unit (end)";
+    _sinks.write_slice({ SliceKind::Unit, _names.intern(name), end.timestamp, end.timestamp });
+  }
+
+  auto on_mismatch(EventRecord<IncludeEvent> end) -> void
+  {
+    auto name = end.event.kind == IncludeEventKind::Enter ? "include (enter)" : "include (leave)";
+    Slice slice { SliceKind::Include, _names.intern(name), end.timestamp, end.timestamp };
+    if (end.event.kind == IncludeEventKind::Enter) {
+      slice.file = _names.intern(end.event.filename.data(), end.event.filename.size());
+    }
+    slice.depth = end.event.depth;
+    _sinks.write_slice(slice);
+  }
+
+  auto on_mismatch(EventRecord<ParseEvent> end) -> void
+  {
+    auto name = "";
+    auto kind = SliceKind::Parse;
+    switch (end.event.kind) {
+    case ParseEventKind::Start:
+      return;
+    case ParseEventKind::PreGenericize:
+      name = "genericize (start)";
+      kind = SliceKind::Genericize;
+      break;
+    case ParseEventKind::Finish:
+      name = "parse (finish)";
+      break;
+    }
+
+    Slice slice { kind, _names.intern(name), end.timestamp, end.timestamp };
+    set_function(slice, end.event.decl);
+    _sinks.write_slice(slice);
+  }
+
+  auto on_mismatch(EventRecord<PassEvent> end) -> void
+  {
+    auto name = end.event.name;
+    name += end.event.kind == PassEventKind::Start ? " (start)" : " (cancelled)";
+    Slice slice { SliceKind::Pass, _names.intern(name.data(), name.size()), end.timestamp, end.timestamp };
+    set_function(slice, end.event.decl);
+    _sinks.write_slice(slice);
+  }
+
+  auto write_inline(const EventRecord<InlineEvent> &record) -> void
+  {
+    decl_name(record.event.decl);
+    for (const auto &callee : record.event.callees) {
+      decl_name(callee.decl);
+    }
+    _sinks.write_inline(record);
+  }
+
+  auto write_counter(const EventRecord<CounterEvent> &record) -> void
+  {
+    _sinks.write_counter(record);
+  }
+
+  auto write_module(const EventRecord<ModuleEvent> &record) -> void
+  {
+    static const char *const names[] = { "module mapper", "module import", "module write" };
+    Slice slice { SliceKind::Module, _names.intern(names[static_cast<int>(record.event.kind)]), record.timestamp,
+      record.timestamp + record.event.duration };
+    if (not record.event.module.empty()) {
+      slice.module = _names.intern(record.event.module.data(), record.event.module.size());
+    }
+    if (not record.event.file.empty()) {
+      slice.file = _names.intern(record.event.file.data(), record.event.file.size());
+    }
+    slice.bytes = record.event.bytes;
+    _sinks.write_slice(slice);
+  }
+
+  auto write_slice(const char *name, EventTimePoint start, EventTimePoint end) -> void
+  {
+    _sinks.write_slice({ SliceKind::Plugin, _names.intern(name), start, end });
+  }
+
+private:
+  auto set_function(Slice &slice, tree decl) -> void
+  {
+    if (decl) {
+      slice.function = decl_name(decl);
+      slice.uid = DECL_PT_UID(decl);
+      if (_scopes_enabled) {
+        slice.scope = decl_scope(decl);
+      }
+    }
+  }
+
+  // Joins the names of the enclosing namespaces, classes and functions with
+  // "::". Template arguments are left out so that instantiations roll up
+  // into their template.
+  auto decl_scope(tree decl) -> NameTable::Id
+  {
+    auto uid = DECL_PT_UID(decl);
+    auto id = _scopes.find(uid);
+    if (id != UidMap::npos) {
+      return id;
+    }
+
+    std::vector<const char *> components;
+    for (auto context = DECL_CONTEXT(decl); context and TREE_CODE(context) != TRANSLATION_UNIT_DECL;) {
+      if (TYPE_P(context)) {
+        auto name = TYPE_NAME(context);
+        if (name and TREE_CODE(name) == TYPE_DECL) {
+          name = DECL_NAME(name);
+        }
+        components.push_back(name ? IDENTIFIER_POINTER(name) : "(anonymous)");
+        context = TYPE_CONTEXT(context);
+      } else if (DECL_P(context)) {
+        components.push_back(DECL_NAME(context) ? IDENTIFIER_POINTER(DECL_NAME(context)) : "(anonymous)");
+        context = DECL_CONTEXT(context);
+      } else {
+        break;
+      }
+    }
+
+    std::string scope;
+    for (auto it = components.rbegin(); it != components.rend(); ++it) {
+      if (not scope.empty()) {
+        scope += "::";
+      }
+      scope += *it;
+    }
+    id = _names.intern(scope.empty() ? "(global)" : scope.c_str());
+    _scopes.insert(uid, id);
+    return id;
+  }
+
+  auto decl_name(tree decl) -> NameTable::Id
+  {
+    auto uid = DECL_PT_UID(decl);
+    auto id = _names.find_decl(uid);
+    if (id == NameTable::npos) {
+      id = _names.intern(::lang_hooks.decl_printable_name(decl, _decl_verbosity));
+      _names.insert_decl(uid, id);
+    }
+    return id;
+  }
+};
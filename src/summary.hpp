@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "event.hpp"
+#include "names.hpp"
+#include "output.hpp"
+#include "sink.hpp"
+
+class SummaryWriter
+{
+  struct Total
+  {
+    long count;
+    EventDuration duration;
+  };
+
+  Output &_out;
+  const NameTable &_names;
+
+  long _slice_count;
+  long _mismatch_count;
+  Total _kinds[7];
+  std::map<NameTable::Id, Total> _passes;
+  std::vector<std::pair<std::string, std::string>> _metadata;
+
+public:
+  SummaryWriter(const SummaryWriter &) = delete;
+  SummaryWriter(SummaryWriter &&) = delete;
+
+  SummaryWriter(Output &out, const NameTable &names)
+    : _out(out)
+    , _names(names)
+    , _slice_count(0)
+    , _mismatch_count(0)
+    , _kinds()
+  {
+  }
+
+  ~SummaryWriter()
+  {
+    _out.printf("{\"slices\":%ld,\"mismatched\":%ld", _slice_count, _mismatch_count);
+    write_total("unit", _kinds[static_cast<int>(SliceKind::Unit)]);
+    write_total("include", _kinds[static_cast<int>(SliceKind::Include)]);
+    write_total("parse", _kinds[static_cast<int>(SliceKind::Parse)]);
+    write_total("genericize", _kinds[static_cast<int>(SliceKind::Genericize)]);
+    write_total("plugin", _kinds[static_cast<int>(SliceKind::Plugin)]);
+    write_total("module", _kinds[static_cast<int>(SliceKind::Module)]);
+    _out.printf(",\"passes\":{");
+    for (auto it = _passes.cbegin(); it != _passes.cend(); ++it) {
+      _out.printf("%s\"%s\":", it == _passes.cbegin() ? "" : ",", _names.str(it->first));
+      write_total(it->second);
+    }
+    _out.printf("}");
+    for (const auto &entry : _metadata) {
+      _out.printf(",\"%s\":%s", entry.first.c_str(), entry.second.c_str());
+    }
+    _out.printf("}\n");
+  }
+
+  auto write_metadata(const std::string &key, const std::string &json) -> void
+  {
+    _metadata.emplace_back(key, json);
+  }
+
+  auto write_slice(const Slice &slice) -> void
+  {
+    ++_slice_count;
+    if (slice.start == slice.end and slice.kind != SliceKind::Plugin and slice.kind != SliceKind::Module) {
+      ++_mismatch_count;
+      return;
+    }
+
+    auto &total = slice.kind == SliceKind::Pass ? _passes[slice.name] : _kinds[static_cast<int>(slice.kind)];
+    total.count += 1;
+    if (slice.kind != SliceKind::Include or slice.depth == 0) {
+      total.duration += slice.end - slice.start;
+    }
+  }
+
+  auto write_inline(const EventRecord<InlineEvent> &) -> void
+  {
+  }
+
+  auto write_counter(const EventRecord<CounterEvent> &) -> void
+  {
+  }
+
+private:
+  auto write_total(const char *name, const Total &total) -> void
+  {
+    _out.printf(",\"%s\":", name);
+    write_total(total);
+  }
+
+  auto write_total(const Total &total) -> void
+  {
+    auto ms = std::chrono::duration<double, std::milli>(total.duration).count();
+    _out.printf("{\"count\":%ld,\"time_ms\":%.3f}", total.count, ms);
+  }
+};
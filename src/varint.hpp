@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// LEB128 varints and zigzag encoding, used by the columnar format and by the
+// spill files of the event logs.
+inline auto zigzag(std::int64_t value) -> std::uint64_t
+{
+  return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+inline auto unzigzag(std::uint64_t value) -> std::int64_t
+{
+  return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+inline auto put_varint(std::string &out, std::uint64_t value) -> void
+{
+  while (value >= 0x80) {
+    out += static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+// Reads a varint from [in, end). A null end reads without a bound.
+inline auto get_varint(const char *&in, const char *end, std::uint64_t &value) -> bool
+{
+  value = 0;
+  for (auto shift = 0; shift < 64 and in != end; shift += 7) {
+    auto byte = static_cast<unsigned char>(*in++);
+    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if (not(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
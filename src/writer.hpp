@@ -5,71 +5,85 @@
 
 #include <chrono>
 #include <cstddef>
-#include <cstdio>
 #include <cstring>
 #include <string>
-#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "column.hpp"
+#include "escape.hpp"
 #include "event.hpp"
-
-#include <gcc-plugin.h>
-
-#include <coretypes.h>
-#include <langhooks.h>
-#include <tree.h>
+#include "names.hpp"
+#include "output.hpp"
+#include "sink.hpp"
 
 class TraceWriter
 {
-  std::FILE *_file;
+  Output &_out;
+  const NameTable &_names;
   EventTimePoint _epoch;
-  int _decl_verbosity;
 
   std::size_t _slice_count;
-  std::unordered_map<unsigned int, std::string> _decl_name_cache;
+  std::vector<std::pair<std::string, std::string>> _metadata;
 
   class SliceWriter
   {
     TraceWriter &_writer;
 
   public:
-    SliceWriter(TraceWriter &writer, const std::string &name, EventTimePoint start, EventTimePoint end)
+    SliceWriter(TraceWriter &writer, const char *name, columnar::Category cat, const char *phase, EventTimePoint start,
+      EventTimePoint end)
       : _writer(writer)
     {
       auto ts = std::chrono::duration_cast<std::chrono::nanoseconds>(start - _writer._epoch).count();
       auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 
       if (_writer._slice_count++ > 0) {
-        std::fprintf(_writer._file, ",");
+        _writer._out.printf(",");
       }
-      std::fprintf(_writer._file, "{\"name\":\"%s\",\"ts\":%ld.%03ld,", name.c_str(), ts / 1000, ts % 1000);
-      if (dur > 0) {
-        std::fprintf(_writer._file, "\"ph\":\"X\",\"dur\":%ld.%03ld,", dur / 1000, dur % 1000);
+      _writer._out.printf("{\"name\":");
+      _writer.write_string(name);
+      _writer._out.printf(",\"cat\":\"%s\"", columnar::category_name(cat));
+      auto magnitude = ts < 0 ? -ts : ts;
+      _writer._out.printf(",\"ts\":%s%ld.%03ld,", ts < 0 ? "-" : "", magnitude / 1000, magnitude % 1000);
+      if (phase) {
+        _writer._out.printf("\"ph\":\"%s\",", phase);
+      } else if (dur > 0) {
+        _writer._out.printf("\"ph\":\"X\",\"dur\":%ld.%03ld,", dur / 1000, dur % 1000);
       } else {
-        std::fprintf(_writer._file, "\"ph\":\"i\",");
+        _writer._out.printf("\"ph\":\"i\",");
       }
-      std::fprintf(_writer._file, "\"pid\":0,\"tid\":0");
+      _writer._out.printf("\"pid\":0,\"tid\":0");
     }
 
     ~SliceWriter()
     {
-      std::fprintf(_writer._file, "}");
+      _writer._out.printf("}");
     }
   };
 
   class ArgWriter
   {
     TraceWriter &_writer;
+    bool _first;
 
   public:
     ArgWriter(TraceWriter &writer)
       : _writer(writer)
+      , _first(true)
+    {
+      _writer._out.printf(",\"args\":{");
+    }
+
+    auto key(const char *name) -> void
     {
-      std::fprintf(_writer._file, ",\"args\":{");
+      _writer._out.printf(_first ? "\"%s\":" : ",\"%s\":", name);
+      _first = false;
     }
 
     ~ArgWriter()
     {
-      std::fprintf(_writer._file, "}");
+      _writer._out.printf("}");
     }
   };
 
@@ -77,135 +91,112 @@ public:
   TraceWriter(const TraceWriter &) = delete;
   TraceWriter(TraceWriter &&) = delete;
 
-  TraceWriter(std::FILE *file, EventTimePoint epoch, int decl_verbosity)
-    : _file(file)
+  TraceWriter(Output &out, const NameTable &names, EventTimePoint epoch)
+    : _out(out)
+    , _names(names)
     , _epoch(epoch)
-    , _decl_verbosity(decl_verbosity)
     , _slice_count(0)
   {
-    std::fprintf(_file, "[");
+    _out.printf("{\"traceEvents\":[");
   }
 
   ~TraceWriter()
   {
-    std::fprintf(_file, "]");
+    _out.printf("]");
+    if (not _metadata.empty()) {
+      _out.printf(",\"otherData\":{");
+      for (auto it = _metadata.cbegin(); it != _metadata.cend(); ++it) {
+        _out.printf(it == _metadata.cbegin() ? "\"%s\":%s" : ",\"%s\":%s", it->first.c_str(), it->second.c_str());
+      }
+      _out.printf("}");
+    }
+    _out.printf("}");
   }
 
-  auto write_slice(EventRecord<UnitEvent> start, EventRecord<UnitEvent> end) -> void
+  auto write_metadata(const std::string &key, const std::string &json) -> void
   {
-    SliceWriter slice { *this, "unit", start.timestamp, end.timestamp };
+    _metadata.emplace_back(key, json);
   }
 
-  auto write_slice(EventRecord<IncludeEvent> start, EventRecord<IncludeEvent> end) -> void
+  auto write_slice(const Slice &slice) -> void
   {
-    SliceWriter slice { *this, "include", start.timestamp, end.timestamp };
-    ArgWriter arg { *this };
-    std::fprintf(_file, "\"file\":\"%s\"", start.event.filename.c_str());
-  }
+    SliceWriter writer { *this, _names.str(slice.name), slice_category(slice.kind), nullptr, slice.start, slice.end };
+    if (slice.function == NameTable::npos and slice.uid == -1u and slice.file == NameTable::npos
+      and slice.module == NameTable::npos and slice.bytes < 0 and not slice.dump and slice.ir_size <= 0) {
+      return;
+    }
 
-  auto write_slice(EventRecord<ParseEvent> start, EventRecord<ParseEvent> end) -> void
-  {
-    auto name = start.event.kind == ParseEventKind::Start ? "parse" : "genericize";
-    SliceWriter slice { *this, name, start.timestamp, end.timestamp };
     ArgWriter arg { *this };
-    std::fprintf(_file, "\"function\":\"%s\"", get_decl_name(start.event.decl).c_str());
-  }
-
-  auto write_slice(EventRecord<PassEvent> start, EventRecord<PassEvent> end) -> void
-  {
-    SliceWriter slice { *this, start.event.name, start.timestamp, end.timestamp };
-    if (start.event.decl) {
-      ArgWriter arg { *this };
-      std::fprintf(_file, "\"function\":\"%s\"", get_decl_name(start.event.decl).c_str());
+    if (slice.file != NameTable::npos) {
+      arg.key("file");
+      write_string(_names.str(slice.file));
     }
-  }
-
-  auto write_slice(EventRecord<UnitEvent> end) -> void
-  {
-    auto name = end.event.kind == UnitEventKind::Start ? "unit (start)" : "unit (end)";
-    SliceWriter slice { *this, name, end.timestamp, end.timestamp };
-  }
-
-  auto write_slice(EventRecord<IncludeEvent> end) -> void
-  {
-    auto name = end.event.kind == IncludeEventKind::Enter ? "include (enter)" : "include (leave)";
-    SliceWriter slice { *this, name, end.timestamp, end.timestamp };
-    if (end.event.kind == IncludeEventKind::Enter) {
-      ArgWriter arg { *this };
-      std::fprintf(_file, "\"file\":\"%s\"", end.event.filename.c_str());
+    if (slice.function != NameTable::npos) {
+      arg.key("function");
+      write_string(_names.str(slice.function));
     }
-  }
-
-  auto write_slice(EventRecord<ParseEvent> end) -> void
-  {
-    auto name = "";
-    switch (end.event.kind) {
-    case ParseEventKind::Start:
-      return;
-    case ParseEventKind::PreGenericize:
-      name = "genericize (start)";
-      break;
-    case ParseEventKind::Finish:
-      name = "parse (finish)";
-      break;
+    if (slice.uid != -1u) {
+      arg.key("uid");
+      _out.printf("%u", slice.uid);
     }
-
-    SliceWriter slice { *this, name, end.timestamp, end.timestamp };
-    if (end.event.decl) {
-      ArgWriter arg { *this };
-      std::fprintf(_file, "\"function\":\"%s\"", get_decl_name(end.event.decl).c_str());
+    if (slice.module != NameTable::npos) {
+      arg.key("module");
+      write_string(_names.str(slice.module));
     }
-  }
-
-  auto write_slice(EventRecord<PassEvent> end) -> void
-  {
-    auto name = end.event.name;
-    name += end.event.kind == PassEventKind::Start ? " (start)" : " (cancelled)";
-    SliceWriter slice { *this, name, end.timestamp, end.timestamp };
-    if (end.event.decl) {
-      ArgWriter arg { *this };
-      std::fprintf(_file, "\"function\":\"%s\"", get_decl_name(end.event.decl).c_str());
+    if (slice.bytes >= 0) {
+      arg.key("bytes");
+      _out.printf("%ld", slice.bytes);
+    }
+    if (slice.dump) {
+      arg.key("dump");
+      _out.printf("true");
+      arg.key("dump_bytes");
+      _out.printf("%ld", slice.dump_bytes);
+    }
+    if (slice.ir_size > 0) {
+      arg.key("ir_size");
+      _out.printf("%ld", slice.ir_size);
     }
   }
 
-  auto write_slice(std::string name, EventTimePoint start, EventTimePoint end) -> void
-  {
-    SliceWriter slice { *this, name, start, end };
-  }
-
-private:
-  auto get_decl_name(tree decl) -> const std::string &
+  auto write_inline(const EventRecord<InlineEvent> &record) -> void
   {
-    auto uid = DECL_PT_UID(decl);
-    auto it = _decl_name_cache.find(uid);
-    if (it == _decl_name_cache.end()) {
-      std::string escaped;
-      auto name = ::lang_hooks.decl_printable_name(decl, _decl_verbosity);
-      std::size_t len;
-      for (; len = std::strcspn(name, "\""), name[len]; name += len + 1) {
-        escaped.append(name, len);
-        escaped += "\\\"";
-      }
-      escaped.append(name, len);
-      it = _decl_name_cache.emplace(uid, escaped).first;
+    SliceWriter slice { *this, "inlined_callees", columnar::Category::Inline, nullptr, record.timestamp,
+      record.timestamp };
+    ArgWriter arg { *this };
+    arg.key("pass");
+    write_string(record.event.pass.c_str());
+    arg.key("function");
+    write_string(_names.str(_names.find_decl(record.event.uid)));
+    arg.key("uid");
+    _out.printf("%u", record.event.uid);
+    arg.key("size");
+    _out.printf("%d", record.event.size);
+    arg.key("callees");
+    _out.printf("[");
+    for (auto it = record.event.callees.cbegin(); it != record.event.callees.cend(); ++it) {
+      _out.printf(it == record.event.callees.cbegin() ? "{\"function\":" : ",{\"function\":");
+      write_string(_names.str(_names.find_decl(it->uid)));
+      _out.printf(",\"uid\":%u,\"size\":%d}", it->uid, it->size);
     }
-    return it->second;
+    _out.printf("]");
   }
-};
-
-struct WriteCallback
-{
-  TraceWriter &writer;
 
-  template <typename E>
-  auto on_match(EventRecord<E> start, EventRecord<E> end) -> void
+  auto write_counter(const EventRecord<CounterEvent> &record) -> void
   {
-    writer.write_slice(std::move(start), std::move(end));
+    SliceWriter slice { *this, "callgraph", columnar::Category::Counter, "C", record.timestamp, record.timestamp };
+    ArgWriter arg { *this };
+    arg.key("nodes");
+    _out.printf("%ld", record.event.nodes);
+    arg.key("pending_expansion");
+    _out.printf("%ld", record.event.pending);
+    arg.key("ir_size");
+    _out.printf("%ld", record.event.ir_size);
   }
 
-  template <typename E>
-  auto on_mismatch(EventRecord<E> end) -> void
+private:
+  auto write_string(const char *str) -> void
   {
-    writer.write_slice(std::move(end));
+    escape_json_string(str, std::strlen(str), [this](const char *data, std::size_t len) { _out.write(data, len); });
   }
 };
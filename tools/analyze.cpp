@@ -0,0 +1,819 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "json.hpp"
+#include "trace.hpp"
+
+namespace {
+
+struct Interval
+{
+  double start;
+  double end;
+};
+
+auto covered_after(std::vector<Interval> intervals, double from) -> double
+{
+  std::sort(intervals.begin(), intervals.end(), [](const Interval &a, const Interval &b) { return a.start < b.start; });
+
+  auto total = 0.0;
+  auto cursor = from;
+  for (const auto &interval : intervals) {
+    auto start = std::max(interval.start, cursor);
+    if (interval.end > start) {
+      total += interval.end - start;
+      cursor = interval.end;
+    }
+  }
+  return total;
+}
+
+struct InlineRecord
+{
+  double ts;
+  unsigned int uid;
+  double size;
+  std::vector<std::pair<std::string, double>> callees;
+};
+
+struct CalleeCost
+{
+  std::string name;
+  double time;
+  double size;
+  std::size_t inlines;
+  std::size_t units;
+  std::size_t last_unit;
+};
+
+auto run_inline(const std::vector<std::string> &paths, std::size_t top) -> int
+{
+  std::unordered_map<std::string, CalleeCost> costs;
+  auto total_time = 0.0;
+
+  for (std::size_t unit = 0; unit < paths.size(); ++unit) {
+    TraceFile trace { paths[unit] };
+    std::unordered_map<unsigned int, std::vector<Interval>> function_slices;
+    std::vector<InlineRecord> records;
+
+    auto ok = trace.load() and trace.for_each_event([&](TraceEvent &event) {
+      if (event.name == "inlined_callees") {
+        InlineRecord record { event.ts, static_cast<unsigned int>(event.args.number_or("uid", -1)),
+          event.args.number_or("size", 0), {} };
+        if (auto callees = event.args.get("callees")) {
+          for (const auto &callee : callees->array) {
+            record.callees.emplace_back(callee.string_or("function", ""), callee.number_or("size", 0));
+          }
+        }
+        records.push_back(std::move(record));
+      } else if (event.phase == 'X') {
+        auto uid = event.args.get("uid");
+        if (uid and uid->type == JsonType::Number) {
+          function_slices[static_cast<unsigned int>(uid->number)].push_back({ event.ts, event.end() });
+        }
+      }
+    });
+    if (not ok) {
+      std::fprintf(stderr, "timetrace-analyze: failed to read %s\n", paths[unit].c_str());
+      return 1;
+    }
+
+    for (const auto &record : records) {
+      auto it = function_slices.find(record.uid);
+      if (it == function_slices.end()) {
+        continue;
+      }
+
+      auto downstream = covered_after(it->second, record.ts);
+      auto callee_size = 0.0;
+      for (const auto &callee : record.callees) {
+        callee_size += callee.second;
+      }
+      auto whole = std::max(record.size, callee_size);
+
+      for (const auto &callee : record.callees) {
+        auto share = whole > 0 ? callee.second / whole : 1.0 / record.callees.size();
+        auto &cost = costs[callee.first];
+        if (cost.inlines == 0) {
+          cost.name = callee.first;
+          cost.last_unit = unit;
+          cost.units = 1;
+        } else if (cost.last_unit != unit) {
+          cost.last_unit = unit;
+          ++cost.units;
+        }
+        cost.time += downstream * share;
+        cost.size += callee.second;
+        ++cost.inlines;
+        total_time += downstream * share;
+      }
+    }
+  }
+
+  std::vector<const CalleeCost *> ranking;
+  for (const auto &entry : costs) {
+    ranking.push_back(&entry.second);
+  }
+  std::sort(ranking.begin(), ranking.end(), [](const CalleeCost *a, const CalleeCost *b) { return a->time > b->time; });
+  if (ranking.size() > top) {
+    ranking.resize(top);
+  }
+
+  std::printf("%4s %12s %7s %8s %6s %9s  %s\n", "rank", "time (ms)", "share", "inlines", "units", "avg size", "callee");
+  for (std::size_t i = 0; i < ranking.size(); ++i) {
+    auto cost = ranking[i];
+    std::printf("%4zu %12.3f %6.2f%% %8zu %6zu %9.1f  %s\n", i + 1, cost->time / 1000,
+      total_time > 0 ? cost->time * 100 / total_time : 0.0, cost->inlines, cost->units, cost->size / cost->inlines,
+      cost->name.c_str());
+  }
+  return 0;
+}
+
+struct HeaderCost
+{
+  std::string name;
+  double time;
+  std::size_t units;
+  long changes;
+};
+
+auto shell_quote(const std::string &value) -> std::string
+{
+  std::string quoted = "'";
+  for (auto c : value) {
+    if (c == '\'') {
+      quoted += "'\\''";
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "'";
+}
+
+// Calls f with each line printed by command. Fails if the command does.
+template <typename F>
+auto read_lines(const std::string &command, F &&f) -> bool
+{
+  auto pipe = ::popen(command.c_str(), "r");
+  if (not pipe) {
+    return false;
+  }
+
+  char buffer[4096];
+  std::string line;
+  while (std::fgets(buffer, sizeof(buffer), pipe)) {
+    line += buffer;
+    if (line.back() == '\n') {
+      line.pop_back();
+      f(line);
+      line.clear();
+    }
+  }
+  if (not line.empty()) {
+    f(line);
+  }
+  return ::pclose(pipe) == 0;
+}
+
+// Counts the commits changing each file of a git repository, keyed by the
+// absolute path of the file.
+auto git_change_counts(const std::string &repository, const std::string &since, bool &ok)
+  -> std::unordered_map<std::string, long>
+{
+  std::unordered_map<std::string, long> counts;
+  std::string top;
+  ok = read_lines("git -C " + shell_quote(repository) + " rev-parse --show-toplevel",
+         [&](const std::string &line) { top = line; })
+    and not top.empty();
+  if (not ok) {
+    return counts;
+  }
+
+  auto command = "git -C " + shell_quote(top) + " log --no-renames --name-only --format=";
+  if (not since.empty()) {
+    command += " --since=" + shell_quote(since);
+  }
+  ok = read_lines(command, [&](const std::string &line) {
+    if (not line.empty()) {
+      ++counts[top + "/" + line];
+    }
+  });
+  return counts;
+}
+
+auto canonical_path(const std::string &path) -> std::string
+{
+  char resolved[PATH_MAX];
+  return ::realpath(path.c_str(), resolved) ? std::string { resolved } : path;
+}
+
+auto run_rebuild_cost(const std::vector<std::string> &paths, std::size_t top, const std::string &repository,
+  const std::string &since) -> int
+{
+  auto weighted = not repository.empty();
+  std::unordered_map<std::string, long> changes;
+  if (weighted) {
+    bool ok;
+    changes = git_change_counts(repository, since, ok);
+    if (not ok) {
+      std::fprintf(stderr, "timetrace-analyze: failed to read the git history of %s\n", repository.c_str());
+      return 1;
+    }
+  }
+
+  // Only the include set and the duration of one unit are held at a time.
+  std::unordered_map<std::string, HeaderCost> costs;
+  auto build_time = 0.0;
+  for (const auto &path : paths) {
+    TraceFile trace { path };
+    std::unordered_set<std::string> headers;
+    auto unit_time = -1.0;
+    auto first = 0.0;
+    auto last = 0.0;
+    auto events = 0;
+
+    auto ok = trace.load() and trace.for_each_event([&](TraceEvent &event) {
+      if (event.phase == 'X' or event.phase == 'i') {
+        first = events++ == 0 ? event.ts : std::min(first, event.ts);
+        last = std::max(last, event.end());
+      }
+      if (event.name == "unit" and event.phase == 'X') {
+        unit_time = event.dur;
+      } else if (event.name.compare(0, 7, "include") == 0) {
+        const auto &file = event.args.string_or("file", "");
+        if (not file.empty() and file[0] != '<') {
+          headers.insert(file);
+        }
+      }
+    });
+    if (not ok) {
+      std::fprintf(stderr, "timetrace-analyze: failed to read %s\n", path.c_str());
+      return 1;
+    }
+
+    if (unit_time < 0) {
+      unit_time = last - first;
+    }
+    build_time += unit_time;
+    for (const auto &header : headers) {
+      auto &cost = costs[header];
+      if (cost.units == 0) {
+        cost.name = header;
+      }
+      cost.time += unit_time;
+      ++cost.units;
+    }
+  }
+
+  std::vector<HeaderCost *> ranking;
+  for (auto &entry : costs) {
+    if (weighted) {
+      auto it = changes.find(canonical_path(entry.first));
+      entry.second.changes = it != changes.end() ? it->second : 0;
+    }
+    ranking.push_back(&entry.second);
+  }
+  std::sort(ranking.begin(), ranking.end(), [&](const HeaderCost *a, const HeaderCost *b) {
+    return weighted and a->time * a->changes != b->time * b->changes ? a->time * a->changes > b->time * b->changes
+                                                                     : a->time > b->time;
+  });
+  if (ranking.size() > top) {
+    ranking.resize(top);
+  }
+
+  if (weighted) {
+    std::printf("%4s %10s %7s %6s %8s %13s  %s\n", "rank", "cost (s)", "share", "units", "changes", "weighted (s)",
+      "header");
+  } else {
+    std::printf("%4s %10s %7s %6s  %s\n", "rank", "cost (s)", "share", "units", "header");
+  }
+  for (std::size_t i = 0; i < ranking.size(); ++i) {
+    auto cost = ranking[i];
+    auto share = build_time > 0 ? cost->time * 100 / build_time : 0.0;
+    if (weighted) {
+      std::printf("%4zu %10.3f %6.2f%% %6zu %8ld %13.3f  %s\n", i + 1, cost->time / 1e6, share, cost->units,
+        cost->changes, cost->time * cost->changes / 1e6, cost->name.c_str());
+    } else {
+      std::printf("%4zu %10.3f %6.2f%% %6zu  %s\n", i + 1, cost->time / 1e6, share, cost->units, cost->name.c_str());
+    }
+  }
+  return 0;
+}
+
+// Include tree of one unit, rebuilt from the nesting of its include slices.
+// Node 0 is the main file, which has no slice of its own.
+struct IncludeTree
+{
+  double unit_time;
+  std::vector<std::string> files;
+  std::vector<std::size_t> parents;
+  std::vector<double> self;
+  std::vector<double> total;
+};
+
+auto read_include_tree(const std::string &path, IncludeTree &tree) -> bool
+{
+  struct IncludeSlice
+  {
+    std::string file;
+    double start;
+    double end;
+  };
+
+  TraceFile trace { path };
+  std::vector<IncludeSlice> slices;
+  tree.unit_time = 0;
+  auto ok = trace.load() and trace.for_each_event([&](TraceEvent &event) {
+    if (event.phase != 'X') {
+      return;
+    }
+    if (event.name == "unit") {
+      tree.unit_time = event.dur;
+    } else if (event.name == "include") {
+      const auto &file = event.args.string_or("file", "");
+      if (not file.empty() and file[0] != '<') {
+        slices.push_back({ file, event.ts, event.end() });
+      }
+    }
+  });
+  if (not ok) {
+    return false;
+  }
+  std::sort(slices.begin(), slices.end(), [](const IncludeSlice &a, const IncludeSlice &b) {
+    return a.start != b.start ? a.start < b.start : a.end > b.end;
+  });
+
+  auto compile = trace.metadata().get("compile");
+  tree.files.assign(1, compile ? compile->string_or("input", "(main)") : "(main)");
+  tree.parents.assign(1, 0);
+  tree.self.assign(1, 0);
+  tree.total.assign(1, 0);
+  std::vector<std::pair<std::size_t, double>> open;
+  for (auto &slice : slices) {
+    while (not open.empty() and open.back().second <= slice.start) {
+      open.pop_back();
+    }
+    auto parent = open.empty() ? 0 : open.back().first;
+    auto duration = slice.end - slice.start;
+    if (parent > 0) {
+      tree.self[parent] -= duration;
+    }
+    open.emplace_back(tree.files.size(), slice.end);
+    tree.files.push_back(std::move(slice.file));
+    tree.parents.push_back(parent);
+    tree.self.push_back(duration);
+    tree.total.push_back(duration);
+  }
+  return true;
+}
+
+// Include edges seen in any unit of the build. A header is only entered the
+// first time it is included in a unit, so the edges of the other units reveal
+// the paths that include guards hide. Each unit has its own node for its main
+// file, so that main files sharing a name do not share their edges.
+struct IncludeGraph
+{
+  std::unordered_map<std::string, unsigned int> ids;
+  std::vector<std::string> files;
+  std::unordered_map<std::uint64_t, double> bounds;
+  std::vector<std::vector<unsigned int>> edges;
+
+  static auto key(unsigned int from, unsigned int to) -> std::uint64_t
+  {
+    return std::uint64_t { from } << 32 | to;
+  }
+
+  static auto root_key(std::size_t unit) -> std::string
+  {
+    return std::string(1, '\0') + std::to_string(unit);
+  }
+
+  auto intern(const std::string &key, const std::string &file) -> unsigned int
+  {
+    auto it = ids.emplace(key, files.size());
+    if (it.second) {
+      files.push_back(file);
+    }
+    return it.first->second;
+  }
+
+  auto find(const std::string &file) const -> unsigned int
+  {
+    auto it = ids.find(file);
+    return it != ids.end() ? it->second : -1u;
+  }
+};
+
+struct WhatIf
+{
+  unsigned int from;
+  unsigned int to;
+  double saved;
+  std::size_t units;
+  std::size_t headers;
+  std::vector<std::pair<std::size_t, double>> per_unit;
+};
+
+// Runs f(i) for every i below count on jobs threads.
+template <typename F>
+auto parallel_for(std::size_t count, unsigned int jobs, F &&f) -> void
+{
+  std::atomic<std::size_t> next { 0 };
+  std::vector<std::thread> workers;
+  for (unsigned int j = 0; j < jobs; ++j) {
+    workers.emplace_back([&]() {
+      for (std::size_t i; (i = next++) < count;) {
+        f(i);
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+auto run_include_whatif(const std::vector<std::string> &paths, std::size_t top,
+  const std::vector<std::pair<std::string, std::string>> &requested, unsigned int jobs) -> int
+{
+  std::mutex mutex;
+  std::atomic<bool> failed { false };
+  auto fail = [&](const std::string &path) {
+    std::lock_guard<std::mutex> lock { mutex };
+    std::fprintf(stderr, "timetrace-analyze: failed to read %s\n", path.c_str());
+    failed = true;
+  };
+
+  // First pass: merge the include trees of all units into one graph, with the
+  // time of the subtrees below each edge as an upper bound of its savings.
+  IncludeGraph graph;
+  auto build_time = 0.0;
+  parallel_for(paths.size(), jobs, [&](std::size_t unit) {
+    IncludeTree tree;
+    if (not read_include_tree(paths[unit], tree)) {
+      fail(paths[unit]);
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock { mutex };
+    build_time += tree.unit_time;
+    std::vector<unsigned int> ids;
+    for (std::size_t i = 0; i < tree.files.size(); ++i) {
+      ids.push_back(graph.intern(i == 0 ? IncludeGraph::root_key(unit) : tree.files[i], tree.files[i]));
+    }
+    for (std::size_t i = 1; i < ids.size(); ++i) {
+      graph.bounds[IncludeGraph::key(ids[tree.parents[i]], ids[i])] += tree.total[i];
+    }
+  });
+  if (failed) {
+    return 1;
+  }
+
+  graph.edges.resize(graph.files.size());
+  for (const auto &bound : graph.bounds) {
+    graph.edges[bound.first >> 32].push_back(static_cast<unsigned int>(bound.first));
+  }
+
+  std::vector<WhatIf> candidates;
+  if (not requested.empty()) {
+    for (const auto &edge : requested) {
+      // A main file may name the root of several units.
+      std::vector<unsigned int> froms { graph.find(edge.first) };
+      for (std::size_t unit = 0; unit < paths.size(); ++unit) {
+        auto root = graph.find(IncludeGraph::root_key(unit));
+        if (root != -1u and graph.files[root] == edge.first) {
+          froms.push_back(root);
+        }
+      }
+      auto to = graph.find(edge.second);
+      auto found = false;
+      for (auto from : froms) {
+        if (from != -1u and to != -1u and graph.bounds.count(IncludeGraph::key(from, to))) {
+          candidates.push_back({ from, to, 0, 0, 0, {} });
+          found = true;
+        }
+      }
+      if (not found) {
+        std::fprintf(stderr, "timetrace-analyze: no unit includes %s from %s\n", edge.second.c_str(),
+          edge.first.c_str());
+        return 1;
+      }
+    }
+  } else {
+    std::vector<std::pair<double, std::uint64_t>> ranking;
+    for (const auto &bound : graph.bounds) {
+      ranking.emplace_back(bound.second, bound.first);
+    }
+    auto count = std::min(top, ranking.size());
+    std::partial_sort(ranking.begin(), ranking.begin() + count, ranking.end(),
+      [](const std::pair<double, std::uint64_t> &a, const std::pair<double, std::uint64_t> &b) {
+        return a.first > b.first;
+      });
+    for (std::size_t i = 0; i < count; ++i) {
+      candidates.push_back(
+        { static_cast<unsigned int>(ranking[i].second >> 32), static_cast<unsigned int>(ranking[i].second), 0, 0, 0,
+          {} });
+    }
+  }
+
+  // Second pass: in each unit, remove the edge and charge the self time of the
+  // headers of the unit that no other path in the graph reaches any more.
+  parallel_for(paths.size(), jobs, [&](std::size_t unit) {
+    IncludeTree tree;
+    if (not read_include_tree(paths[unit], tree)) {
+      fail(paths[unit]);
+      return;
+    }
+
+    std::vector<unsigned int> ids;
+    std::unordered_map<unsigned int, char> reached;
+    for (std::size_t i = 0; i < tree.files.size(); ++i) {
+      ids.push_back(graph.find(i == 0 ? IncludeGraph::root_key(unit) : tree.files[i]));
+      reached[ids.back()] = 0;
+    }
+
+    std::vector<std::pair<double, std::size_t>> savings;
+    std::vector<unsigned int> queue;
+    for (const auto &candidate : candidates) {
+      if (not reached.count(candidate.from) or not reached.count(candidate.to)) {
+        savings.emplace_back(0, 0);
+        continue;
+      }
+
+      for (auto &entry : reached) {
+        entry.second = 0;
+      }
+      reached[ids[0]] = 1;
+      queue.assign(1, ids[0]);
+      while (not queue.empty()) {
+        auto from = queue.back();
+        queue.pop_back();
+        for (auto to : graph.edges[from]) {
+          if (from == candidate.from and to == candidate.to) {
+            continue;
+          }
+          auto it = reached.find(to);
+          if (it != reached.end() and not it->second) {
+            it->second = 1;
+            queue.push_back(to);
+          }
+        }
+      }
+
+      auto saved = 0.0;
+      std::unordered_set<unsigned int> headers;
+      for (std::size_t i = 1; i < ids.size(); ++i) {
+        if (not reached[ids[i]]) {
+          saved += tree.self[i];
+          headers.insert(ids[i]);
+        }
+      }
+      savings.emplace_back(saved, headers.size());
+    }
+
+    std::lock_guard<std::mutex> lock { mutex };
+    for (std::size_t c = 0; c < candidates.size(); ++c) {
+      if (savings[c].second > 0) {
+        candidates[c].saved += savings[c].first;
+        candidates[c].headers += savings[c].second;
+        candidates[c].units += 1;
+        candidates[c].per_unit.emplace_back(unit, savings[c].first);
+      }
+    }
+  });
+  if (failed) {
+    return 1;
+  }
+
+  if (requested.empty()) {
+    std::sort(candidates.begin(), candidates.end(), [](const WhatIf &a, const WhatIf &b) { return a.saved > b.saved; });
+  }
+  std::printf("%4s %10s %7s %6s %8s  %s\n", "rank", "saved (s)", "share", "units", "headers", "edge");
+  for (std::size_t i = 0; i < candidates.size(); ++i) {
+    const auto &candidate = candidates[i];
+    std::printf("%4zu %10.3f %6.2f%% %6zu %8.1f  %s -> %s\n", i + 1, candidate.saved / 1e6,
+      build_time > 0 ? candidate.saved * 100 / build_time : 0.0, candidate.units,
+      candidate.units > 0 ? static_cast<double>(candidate.headers) / candidate.units : 0.0,
+      graph.files[candidate.from].c_str(), graph.files[candidate.to].c_str());
+  }
+
+  if (not requested.empty()) {
+    for (auto &candidate : candidates) {
+      std::printf("\n%s -> %s\n", graph.files[candidate.from].c_str(), graph.files[candidate.to].c_str());
+      std::sort(candidate.per_unit.begin(), candidate.per_unit.end());
+      for (const auto &entry : candidate.per_unit) {
+        std::printf("%12.3f ms  %s\n", entry.second / 1000, paths[entry.first].c_str());
+      }
+    }
+  }
+  return 0;
+}
+
+struct PassSample
+{
+  std::string function;
+  std::size_t unit;
+  double size;
+  double time;
+};
+
+struct PassFit
+{
+  std::string name;
+  double exponent;
+  double intercept;
+  double r2;
+  double time;
+  std::size_t functions;
+};
+
+// Least squares fit of log(time) = intercept + exponent * log(size).
+auto fit_pass(const std::string &name, const std::vector<PassSample> &samples, PassFit &fit) -> bool
+{
+  fit = { name, 0, 0, 0, 0, samples.size() };
+  auto sx = 0.0;
+  auto sy = 0.0;
+  for (const auto &sample : samples) {
+    sx += std::log(sample.size);
+    sy += std::log(sample.time);
+    fit.time += sample.time;
+  }
+  auto n = static_cast<double>(samples.size());
+  auto mx = sx / n;
+  auto my = sy / n;
+  auto sxx = 0.0;
+  auto sxy = 0.0;
+  auto syy = 0.0;
+  for (const auto &sample : samples) {
+    auto dx = std::log(sample.size) - mx;
+    auto dy = std::log(sample.time) - my;
+    sxx += dx * dx;
+    sxy += dx * dy;
+    syy += dy * dy;
+  }
+  if (samples.size() < 2 or sxx <= 0) {
+    return false;
+  }
+  fit.exponent = sxy / sxx;
+  fit.intercept = my - fit.exponent * mx;
+  fit.r2 = syy > 0 ? sxy * sxy / (sxx * syy) : 1.0;
+  return true;
+}
+
+auto run_scaling(const std::vector<std::string> &paths, std::size_t top, double threshold, double min_time) -> int
+{
+  std::unordered_map<std::string, std::vector<PassSample>> passes;
+  for (std::size_t unit = 0; unit < paths.size(); ++unit) {
+    TraceFile trace { paths[unit] };
+    auto ok = trace.load() and trace.for_each_event([&](TraceEvent &event) {
+      auto size = event.args.number_or("ir_size", 0);
+      if (event.phase == 'X' and size > 0 and event.dur > 0) {
+        passes[event.name].push_back({ event.args.string_or("function", ""), unit, size, event.dur });
+      }
+    });
+    if (not ok) {
+      std::fprintf(stderr, "timetrace-analyze: failed to read %s\n", paths[unit].c_str());
+      return 1;
+    }
+  }
+
+  struct Outlier
+  {
+    const PassSample *sample;
+    const PassFit *fit;
+    double expected;
+  };
+
+  std::vector<PassFit> fits;
+  fits.reserve(passes.size());
+  for (const auto &entry : passes) {
+    PassFit fit;
+    if (entry.second.size() >= 8 and fit_pass(entry.first, entry.second, fit)) {
+      fits.push_back(fit);
+    }
+  }
+  std::sort(fits.begin(), fits.end(), [](const PassFit &a, const PassFit &b) { return a.exponent > b.exponent; });
+
+  std::vector<Outlier> outliers;
+  for (const auto &fit : fits) {
+    for (const auto &sample : passes[fit.name]) {
+      auto expected = std::exp(fit.intercept) * std::pow(sample.size, fit.exponent);
+      if (sample.time >= min_time and sample.time >= expected * threshold) {
+        outliers.push_back({ &sample, &fit, expected });
+      }
+    }
+  }
+  std::sort(outliers.begin(), outliers.end(), [](const Outlier &a, const Outlier &b) {
+    return a.sample->time - a.expected > b.sample->time - b.expected;
+  });
+  if (outliers.size() > top) {
+    outliers.resize(top);
+  }
+
+  std::printf("%9s %6s %10s %9s  %s\n", "exponent", "r2", "functions", "time (s)", "pass");
+  for (const auto &fit : fits) {
+    std::printf("%9.2f %6.2f %10zu %9.3f  %s\n", fit.exponent, fit.r2, fit.functions, fit.time / 1e6,
+      fit.name.c_str());
+  }
+
+  std::printf("\n%4s %11s %13s %7s %9s  %s\n", "rank", "time (ms)", "expected (ms)", "ratio", "ir size",
+    "pass / function / trace");
+  for (std::size_t i = 0; i < outliers.size(); ++i) {
+    const auto &outlier = outliers[i];
+    std::printf("%4zu %11.3f %13.3f %6.1fx %9.0f  %s / %s / %s\n", i + 1, outlier.sample->time / 1000,
+      outlier.expected / 1000, outlier.sample->time / outlier.expected, outlier.sample->size,
+      outlier.fit->name.c_str(), outlier.sample->function.c_str(), paths[outlier.sample->unit].c_str());
+  }
+  return 0;
+}
+
+auto usage() -> int
+{
+  std::fprintf(stderr,
+    "usage: timetrace-analyze <command> [options] <trace>...\n"
+    "\n"
+    "commands:\n"
+    "  inline [--top <n>]    rank inlined callees by the compile time spent on\n"
+    "                        their callers after inlining (requires traces taken\n"
+    "                        with -fplugin-arg-timetrace-inline-callees)\n"
+    "  rebuild-cost [--top <n>] [--git <repository> [--since <date>]]\n"
+    "                        rank headers by the compile time of the units that\n"
+    "                        include them, optionally weighted by the number of\n"
+    "                        commits changing them\n"
+    "  include-whatif [--top <n>] [--edge <includer> <header>]... [--jobs <n>]\n"
+    "                        estimate the compile time saved by removing include\n"
+    "                        edges, either the given ones or the most expensive\n"
+    "  scaling [--top <n>] [--threshold <factor>] [--min-time <ms>]\n"
+    "                        fit the time of each pass against the IR size of\n"
+    "                        functions and list the runs far above the fit\n"
+    "                        (requires traces taken with\n"
+    "                        -fplugin-arg-timetrace-ir-size)\n");
+  return 2;
+}
+
+} // namespace
+
+auto main(int argc, char **argv) -> int
+{
+  if (argc < 2) {
+    return usage();
+  }
+
+  std::string command = argv[1];
+  std::size_t top = 20;
+  std::string repository;
+  std::string since;
+  std::vector<std::pair<std::string, std::string>> edges;
+  auto jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  auto threshold = 10.0;
+  auto min_time = 1.0;
+  std::vector<std::string> paths;
+  for (auto i = 2; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--top") == 0 and i + 1 < argc) {
+      top = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--git") == 0 and i + 1 < argc) {
+      repository = argv[++i];
+    } else if (std::strcmp(argv[i], "--since") == 0 and i + 1 < argc) {
+      since = argv[++i];
+    } else if (std::strcmp(argv[i], "--edge") == 0 and i + 2 < argc) {
+      edges.emplace_back(argv[i + 1], argv[i + 2]);
+      i += 2;
+    } else if (std::strcmp(argv[i], "--jobs") == 0 and i + 1 < argc) {
+      jobs = std::max(std::strtoul(argv[++i], nullptr, 10), 1ul);
+    } else if (std::strcmp(argv[i], "--threshold") == 0 and i + 1 < argc) {
+      threshold = std::strtod(argv[++i], nullptr);
+    } else if (std::strcmp(argv[i], "--min-time") == 0 and i + 1 < argc) {
+      min_time = std::strtod(argv[++i], nullptr);
+    } else if (argv[i][0] == '-') {
+      return usage();
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+
+  if (command == "inline" and not paths.empty()) {
+    return run_inline(paths, top);
+  } else if (command == "rebuild-cost" and not paths.empty()) {
+    return run_rebuild_cost(paths, top, repository, since);
+  } else if (command == "include-whatif" and not paths.empty()) {
+    return run_include_whatif(paths, top, edges, jobs);
+  } else if (command == "scaling" and not paths.empty()) {
+    return run_scaling(paths, top, threshold, min_time * 1000);
+  }
+  return usage();
+}
@@ -0,0 +1,580 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "column.hpp"
+#include "json.hpp"
+#include "names.hpp"
+#include "trace.hpp"
+
+namespace {
+
+struct Trace
+{
+  NameTable strings;
+  NameTable details;
+  std::vector<std::pair<std::string, std::string>> metadata;
+  std::vector<columnar::Row> rows;
+};
+
+enum class Format
+{
+  Json,
+  Columnar,
+  Perfetto,
+};
+
+auto ends_with(const std::string &str, const char *suffix) -> bool
+{
+  auto len = std::strlen(suffix);
+  return str.size() >= len and str.compare(str.size() - len, len, suffix) == 0;
+}
+
+auto parse_format(const std::string &name, Format &format) -> bool
+{
+  if (name == "json") {
+    format = Format::Json;
+  } else if (name == "columnar") {
+    format = Format::Columnar;
+  } else if (name == "perfetto") {
+    format = Format::Perfetto;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+auto guess_format(const std::string &path, Format &format) -> bool
+{
+  if (ends_with(path, ".json")) {
+    format = Format::Json;
+  } else if (ends_with(path, ".columnar")) {
+    format = Format::Columnar;
+  } else if (ends_with(path, ".pftrace") or ends_with(path, ".perfetto-trace")) {
+    format = Format::Perfetto;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Traces written before categories were recorded are classified by name.
+auto infer_category(const TraceEvent &event) -> columnar::Category
+{
+  for (std::size_t i = 0; i < columnar::category_count; ++i) {
+    auto cat = static_cast<columnar::Category>(i);
+    if (event.cat == columnar::category_name(cat)) {
+      return cat;
+    }
+  }
+
+  auto prefixed = [&](const char *prefix) { return event.name.compare(0, std::strlen(prefix), prefix) == 0; };
+  if (event.phase == 'C') {
+    return columnar::Category::Counter;
+  } else if (event.name == "inlined_callees") {
+    return columnar::Category::Inline;
+  } else if (event.name == "plugin_dump") {
+    return columnar::Category::Plugin;
+  } else if (prefixed("unit")) {
+    return columnar::Category::Unit;
+  } else if (prefixed("include")) {
+    return columnar::Category::Include;
+  } else if (prefixed("parse")) {
+    return columnar::Category::Parse;
+  } else if (prefixed("genericize")) {
+    return columnar::Category::Genericize;
+  }
+  return columnar::Category::Pass;
+}
+
+auto load(TraceFile &file, Trace &trace) -> bool
+{
+  if (not file.load()) {
+    return false;
+  }
+
+  auto begin = file.data().data();
+  auto end = begin + file.data().size() - 1;
+  if (columnar::Reader::matches(begin, end)) {
+    columnar::Reader reader { begin, end };
+    if (not reader.read(trace.strings, trace.details, trace.metadata)) {
+      return false;
+    }
+    trace.rows.reserve(reader.rows());
+    return reader.for_each_row([&](const columnar::Row &row) { trace.rows.push_back(row); });
+  }
+
+  std::string detail;
+  auto ok = file.for_each_event([&](TraceEvent &event) {
+    columnar::Row row { std::llround(event.ts * 1000), std::llround(event.dur * 1000), infer_category(event),
+      trace.strings.intern(event.name.data(), event.name.size()) };
+    auto is_counter = row.cat == columnar::Category::Counter;
+    auto is_slice = row.cat != columnar::Category::Inline and not is_counter;
+    JsonValue rest;
+    rest.type = JsonType::Object;
+    for (auto &entry : event.args.object) {
+      const auto &key = entry.first;
+      const auto &value = entry.second;
+      auto string = [&]() { return trace.strings.intern(value.string.data(), value.string.size()); };
+      if (key == "function" and value.type == JsonType::String) {
+        row.function = string();
+      } else if (is_slice and key == "uid" and value.type == JsonType::Number) {
+        row.uid = static_cast<unsigned int>(value.number);
+      } else if (is_slice and key == "file" and value.type == JsonType::String) {
+        row.file = string();
+      } else if (is_slice and key == "module" and value.type == JsonType::String) {
+        row.module = string();
+      } else if (is_slice and key == "bytes" and value.type == JsonType::Number) {
+        row.bytes = std::llround(value.number);
+      } else if (is_slice and key == "dump" and value.type == JsonType::Bool) {
+        row.dump = value.boolean;
+      } else if (is_slice and key == "dump_bytes" and value.type == JsonType::Number) {
+        row.dump_bytes = std::llround(value.number);
+      } else if (is_slice and key == "ir_size" and value.type == JsonType::Number) {
+        row.ir_size = std::llround(value.number);
+      } else if (is_counter and key == "nodes" and value.type == JsonType::Number) {
+        row.nodes = std::llround(value.number);
+      } else if (is_counter and key == "pending_expansion" and value.type == JsonType::Number) {
+        row.pending = std::llround(value.number);
+      } else if (is_counter and key == "ir_size" and value.type == JsonType::Number) {
+        row.ir_size = std::llround(value.number);
+      } else {
+        rest.object.push_back(std::move(entry));
+      }
+    }
+
+    if (not rest.object.empty()) {
+      detail.clear();
+      append_json(detail, rest);
+      row.detail = trace.details.intern(detail.data(), detail.size());
+    }
+    trace.rows.push_back(row);
+  });
+  if (not ok) {
+    return false;
+  }
+
+  for (const auto &entry : file.metadata().object) {
+    detail.clear();
+    append_json(detail, entry.second);
+    trace.metadata.emplace_back(entry.first, detail);
+  }
+  return true;
+}
+
+// Arguments of a row in the order the plugin writes them.
+auto row_args(const Trace &trace, const columnar::Row &row) -> JsonValue
+{
+  JsonValue args;
+  args.type = JsonType::Object;
+  auto add = [&](const char *key, JsonType type) -> JsonValue & {
+    args.object.emplace_back(key, JsonValue {});
+    args.object.back().second.type = type;
+    return args.object.back().second;
+  };
+  auto add_string = [&](const char *key, NameTable::Id id) {
+    if (id != NameTable::npos) {
+      add(key, JsonType::String).string.assign(trace.strings.str(id), trace.strings.length(id));
+    }
+  };
+  add_string("file", row.file);
+  add_string("function", row.function);
+  if (row.uid != -1u and row.cat != columnar::Category::Inline) {
+    add("uid", JsonType::Number).number = row.uid;
+  }
+  add_string("module", row.module);
+  if (row.bytes >= 0) {
+    add("bytes", JsonType::Number).number = row.bytes;
+  }
+  if (row.dump) {
+    add("dump", JsonType::Bool).boolean = true;
+    add("dump_bytes", JsonType::Number).number = row.dump_bytes;
+  }
+  if (row.cat == columnar::Category::Counter) {
+    if (row.nodes >= 0) {
+      add("nodes", JsonType::Number).number = row.nodes;
+    }
+    if (row.pending >= 0) {
+      add("pending_expansion", JsonType::Number).number = row.pending;
+    }
+    add("ir_size", JsonType::Number).number = row.ir_size;
+  } else if (row.ir_size > 0) {
+    add("ir_size", JsonType::Number).number = row.ir_size;
+  }
+  if (row.detail != NameTable::npos) {
+    JsonValue detail;
+    auto text = trace.details.str(row.detail);
+    JsonParser parser { text, text + trace.details.length(row.detail) };
+    if (parser.parse(detail)) {
+      for (auto &entry : detail.object) {
+        args.object.push_back(std::move(entry));
+      }
+    }
+  }
+  return args;
+}
+
+auto write_json(std::FILE *file, const Trace &trace) -> void
+{
+  std::string out;
+  out += "{\"traceEvents\":[";
+  for (auto it = trace.rows.cbegin(); it != trace.rows.cend(); ++it) {
+    char buffer[128];
+    if (it != trace.rows.cbegin()) {
+      out += ',';
+    }
+    out += "{\"name\":";
+    append_json_string(out, trace.strings.str(it->name));
+    auto magnitude = static_cast<long long>(it->ts < 0 ? -it->ts : it->ts);
+    std::snprintf(buffer, sizeof(buffer), ",\"cat\":\"%s\",\"ts\":%s%lld.%03lld,", columnar::category_name(it->cat),
+      it->ts < 0 ? "-" : "", magnitude / 1000, magnitude % 1000);
+    out += buffer;
+    if (it->cat == columnar::Category::Counter) {
+      out += "\"ph\":\"C\",";
+    } else if (it->dur > 0) {
+      std::snprintf(buffer, sizeof(buffer), "\"ph\":\"X\",\"dur\":%lld.%03lld,", static_cast<long long>(it->dur / 1000),
+        static_cast<long long>(it->dur % 1000));
+      out += buffer;
+    } else {
+      out += "\"ph\":\"i\",";
+    }
+    out += "\"pid\":0,\"tid\":0";
+
+    auto args = row_args(trace, *it);
+    if (not args.object.empty()) {
+      out += ",\"args\":";
+      append_json(out, args);
+    }
+    out += '}';
+
+    if (out.size() >= 1 << 16) {
+      std::fwrite(out.data(), 1, out.size(), file);
+      out.clear();
+    }
+  }
+
+  out += ']';
+  if (not trace.metadata.empty()) {
+    out += ",\"otherData\":{";
+    for (auto it = trace.metadata.cbegin(); it != trace.metadata.cend(); ++it) {
+      if (it != trace.metadata.cbegin()) {
+        out += ',';
+      }
+      append_json_string(out, it->first);
+      out += ':';
+      out += it->second;
+    }
+    out += '}';
+  }
+  out += '}';
+  std::fwrite(out.data(), 1, out.size(), file);
+}
+
+auto write_columnar(std::FILE *file, const Trace &trace) -> void
+{
+  columnar::Encoder encoder;
+  for (const auto &row : trace.rows) {
+    encoder.add(row);
+  }
+  auto write = [&](const char *data, std::size_t len) { std::fwrite(data, 1, len, file); };
+  encoder.write(write, trace.strings, trace.details, trace.metadata);
+}
+
+// Minimal protobuf encoding of the Perfetto trace format (perfetto.protos.Trace).
+namespace proto {
+
+auto put_tag(std::string &out, unsigned field, unsigned wire) -> void
+{
+  put_varint(out, (field << 3) | wire);
+}
+
+auto put_uint(std::string &out, unsigned field, std::uint64_t value) -> void
+{
+  put_tag(out, field, 0);
+  put_varint(out, value);
+}
+
+auto put_double(std::string &out, unsigned field, double value) -> void
+{
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  put_tag(out, field, 1);
+  for (auto i = 0; i < 8; ++i) {
+    out += static_cast<char>(bits >> (i * 8));
+  }
+}
+
+auto put_bytes(std::string &out, unsigned field, const char *data, std::size_t len) -> void
+{
+  put_tag(out, field, 2);
+  put_varint(out, len);
+  out.append(data, len);
+}
+
+auto put_bytes(std::string &out, unsigned field, const std::string &value) -> void
+{
+  put_bytes(out, field, value.data(), value.size());
+}
+
+enum : unsigned
+{
+  TracePacket = 1,
+
+  PacketTimestamp = 8,
+  PacketSequenceId = 10,
+  PacketTrackEvent = 11,
+  PacketTrackDescriptor = 60,
+
+  TrackUuid = 1,
+  TrackName = 2,
+  TrackCounter = 8,
+
+  EventDebugAnnotations = 4,
+  EventType = 9,
+  EventTrackUuid = 11,
+  EventCategories = 22,
+  EventName = 23,
+  EventDoubleCounterValue = 44,
+
+  AnnotationBool = 2,
+  AnnotationInt = 4,
+  AnnotationDouble = 5,
+  AnnotationString = 6,
+  AnnotationJson = 9,
+  AnnotationName = 10,
+
+  SliceBegin = 1,
+  SliceEnd = 2,
+  Instant = 3,
+  Counter = 4,
+};
+
+} // namespace proto
+
+class PerfettoWriter
+{
+  std::FILE *_file;
+  std::string _message;
+  std::vector<std::string> _counter_tracks;
+
+  static constexpr std::uint64_t slice_track = 1;
+
+public:
+  PerfettoWriter(std::FILE *file)
+    : _file(file)
+  {
+    _message.clear();
+    proto::put_uint(_message, proto::TrackUuid, slice_track);
+    proto::put_bytes(_message, proto::TrackName, "gcc", 3);
+    write_packet(proto::PacketTrackDescriptor, 0);
+  }
+
+  auto slice(std::int64_t ts, unsigned type, const Trace &trace, const columnar::Row &row) -> void
+  {
+    _message.clear();
+    proto::put_uint(_message, proto::EventType, type);
+    proto::put_uint(_message, proto::EventTrackUuid, slice_track);
+    if (type != proto::SliceEnd) {
+      proto::put_bytes(_message, proto::EventCategories, columnar::category_name(row.cat),
+        std::strlen(columnar::category_name(row.cat)));
+      proto::put_bytes(_message, proto::EventName, trace.strings.str(row.name), trace.strings.length(row.name));
+      for (const auto &entry : row_args(trace, row).object) {
+        write_annotation(entry.first, entry.second);
+      }
+    }
+    write_packet(proto::PacketTrackEvent, ts);
+  }
+
+  auto counter(const Trace &trace, const columnar::Row &row) -> void
+  {
+    for (const auto &entry : row_args(trace, row).object) {
+      if (entry.second.type != JsonType::Number) {
+        continue;
+      }
+      auto track = counter_track(entry.first);
+      _message.clear();
+      proto::put_uint(_message, proto::EventType, proto::Counter);
+      proto::put_uint(_message, proto::EventTrackUuid, track);
+      proto::put_double(_message, proto::EventDoubleCounterValue, entry.second.number);
+      write_packet(proto::PacketTrackEvent, row.ts);
+    }
+  }
+
+private:
+  auto counter_track(const std::string &name) -> std::uint64_t
+  {
+    auto it = std::find(_counter_tracks.begin(), _counter_tracks.end(), name);
+    auto uuid = slice_track + 1 + (it - _counter_tracks.begin());
+    if (it == _counter_tracks.end()) {
+      _counter_tracks.push_back(name);
+      _message.clear();
+      proto::put_uint(_message, proto::TrackUuid, uuid);
+      proto::put_bytes(_message, proto::TrackName, name);
+      proto::put_bytes(_message, proto::TrackCounter, "", 0);
+      write_packet(proto::PacketTrackDescriptor, 0);
+    }
+    return uuid;
+  }
+
+  auto write_annotation(const std::string &name, const JsonValue &value) -> void
+  {
+    std::string annotation;
+    proto::put_bytes(annotation, proto::AnnotationName, name);
+    switch (value.type) {
+    case JsonType::Bool:
+      proto::put_uint(annotation, proto::AnnotationBool, value.boolean);
+      break;
+    case JsonType::Number:
+      if (value.number == std::floor(value.number) and std::fabs(value.number) < 9e15) {
+        proto::put_uint(annotation, proto::AnnotationInt, static_cast<std::uint64_t>(std::llround(value.number)));
+      } else {
+        proto::put_double(annotation, proto::AnnotationDouble, value.number);
+      }
+      break;
+    case JsonType::String:
+      proto::put_bytes(annotation, proto::AnnotationString, value.string);
+      break;
+    default: {
+      std::string json;
+      append_json(json, value);
+      proto::put_bytes(annotation, proto::AnnotationJson, json);
+      break;
+    }
+    }
+    proto::put_bytes(_message, proto::EventDebugAnnotations, annotation);
+  }
+
+  auto write_packet(unsigned field, std::int64_t ts) -> void
+  {
+    std::string packet;
+    if (field == proto::PacketTrackEvent) {
+      proto::put_uint(packet, proto::PacketTimestamp, static_cast<std::uint64_t>(std::max<std::int64_t>(ts, 0)));
+    }
+    proto::put_uint(packet, proto::PacketSequenceId, 1);
+    proto::put_bytes(packet, field, _message);
+
+    std::string framed;
+    proto::put_bytes(framed, proto::TracePacket, packet);
+    std::fwrite(framed.data(), 1, framed.size(), _file);
+  }
+};
+
+// Track events must be sorted by time and properly nested, so every slice is
+// split into begin and end markers ordered with inner slices closing first.
+auto write_perfetto(std::FILE *file, const Trace &trace) -> void
+{
+  struct Marker
+  {
+    std::int64_t ts;
+    unsigned type;
+    std::int64_t key;
+    std::size_t row;
+  };
+
+  std::vector<Marker> markers;
+  for (std::size_t i = 0; i < trace.rows.size(); ++i) {
+    const auto &row = trace.rows[i];
+    if (row.cat == columnar::Category::Counter) {
+      markers.push_back({ row.ts, proto::Counter, 0, i });
+    } else if (row.dur > 0) {
+      markers.push_back({ row.ts, proto::SliceBegin, -row.dur, i });
+      markers.push_back({ row.ts + row.dur, proto::SliceEnd, -row.ts, i });
+    } else {
+      markers.push_back({ row.ts, proto::Instant, 0, i });
+    }
+  }
+
+  auto rank = [](unsigned type) { return type == proto::SliceEnd ? 0 : type == proto::SliceBegin ? 1 : 2; };
+  std::stable_sort(markers.begin(), markers.end(), [&](const Marker &a, const Marker &b) {
+    if (a.ts != b.ts) {
+      return a.ts < b.ts;
+    }
+    if (rank(a.type) != rank(b.type)) {
+      return rank(a.type) < rank(b.type);
+    }
+    return a.key < b.key;
+  });
+
+  PerfettoWriter writer { file };
+  for (const auto &marker : markers) {
+    const auto &row = trace.rows[marker.row];
+    if (marker.type == proto::Counter) {
+      writer.counter(trace, row);
+    } else {
+      writer.slice(marker.ts, marker.type, trace, row);
+    }
+  }
+}
+
+auto usage() -> int
+{
+  std::fprintf(stderr,
+    "usage: timetrace-convert [--to <format>] <input> <output>\n"
+    "\n"
+    "The input is a JSON or columnar trace. The output format is one of json,\n"
+    "columnar, or perfetto, and is guessed from the extension of <output>\n"
+    "(.json, .columnar, .pftrace) unless --to is given.\n");
+  return 2;
+}
+
+} // namespace
+
+auto main(int argc, char **argv) -> int
+{
+  std::string to;
+  std::vector<std::string> paths;
+  for (auto i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--to") == 0 and i + 1 < argc) {
+      to = argv[++i];
+    } else if (argv[i][0] == '-') {
+      return usage();
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.size() != 2) {
+    return usage();
+  }
+
+  Format format;
+  if (to.empty() ? not guess_format(paths[1], format) : not parse_format(to, format)) {
+    return usage();
+  }
+
+  TraceFile input { paths[0] };
+  Trace trace;
+  if (not load(input, trace)) {
+    std::fprintf(stderr, "timetrace-convert: failed to read %s\n", paths[0].c_str());
+    return 1;
+  }
+
+  auto file = std::fopen(paths[1].c_str(), "wb");
+  if (not file) {
+    std::fprintf(stderr, "timetrace-convert: failed to open %s\n", paths[1].c_str());
+    return 1;
+  }
+  switch (format) {
+  case Format::Json:
+    write_json(file, trace);
+    break;
+  case Format::Columnar:
+    write_columnar(file, trace);
+    break;
+  case Format::Perfetto:
+    write_perfetto(file, trace);
+    break;
+  }
+  if (std::fclose(file) != 0) {
+    std::fprintf(stderr, "timetrace-convert: failed to write %s\n", paths[1].c_str());
+    return 1;
+  }
+  return 0;
+}
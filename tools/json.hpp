@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "escape.hpp"
+
+enum class JsonType
+{
+  Null,
+  Bool,
+  Number,
+  String,
+  Array,
+  Object,
+};
+
+struct JsonValue
+{
+  JsonType type;
+  bool boolean;
+  double number;
+  std::string string;
+  std::vector<JsonValue> array;
+  std::vector<std::pair<std::string, JsonValue>> object;
+
+  JsonValue()
+    : type(JsonType::Null)
+    , boolean(false)
+    , number(0)
+  {
+  }
+
+  auto get(const char *key) const -> const JsonValue *
+  {
+    for (const auto &entry : object) {
+      if (entry.first == key) {
+        return &entry.second;
+      }
+    }
+    return nullptr;
+  }
+
+  auto number_or(const char *key, double fallback) const -> double
+  {
+    auto value = get(key);
+    return value and value->type == JsonType::Number ? value->number : fallback;
+  }
+
+  auto string_or(const char *key, const std::string &fallback) const -> const std::string &
+  {
+    auto value = get(key);
+    return value and value->type == JsonType::String ? value->string : fallback;
+  }
+};
+
+inline auto append_json_string(std::string &out, const std::string &value) -> void
+{
+  escape_json_string(value.data(), value.size(), [&](const char *data, std::size_t len) { out.append(data, len); });
+}
+
+inline auto append_json(std::string &out, const JsonValue &value) -> void
+{
+  switch (value.type) {
+  case JsonType::Null:
+    out += "null";
+    break;
+  case JsonType::Bool:
+    out += value.boolean ? "true" : "false";
+    break;
+  case JsonType::Number: {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.15g", value.number);
+    out += number;
+    break;
+  }
+  case JsonType::String:
+    append_json_string(out, value.string);
+    break;
+  case JsonType::Array:
+    out += '[';
+    for (auto it = value.array.cbegin(); it != value.array.cend(); ++it) {
+      if (it != value.array.cbegin()) {
+        out += ',';
+      }
+      append_json(out, *it);
+    }
+    out += ']';
+    break;
+  case JsonType::Object:
+    out += '{';
+    for (auto it = value.object.cbegin(); it != value.object.cend(); ++it) {
+      if (it != value.object.cbegin()) {
+        out += ',';
+      }
+      append_json_string(out, it->first);
+      out += ':';
+      append_json(out, it->second);
+    }
+    out += '}';
+    break;
+  }
+}
+
+class JsonParser
+{
+  const char *_cur;
+  const char *_end;
+
+public:
+  JsonParser(const char *begin, const char *end)
+    : _cur(begin)
+    , _end(end)
+  {
+  }
+
+  auto at_end() -> bool
+  {
+    skip_whitespace();
+    return _cur == _end;
+  }
+
+  auto peek() -> char
+  {
+    skip_whitespace();
+    return _cur == _end ? '\0' : *_cur;
+  }
+
+  auto consume(char c) -> bool
+  {
+    if (peek() == c) {
+      ++_cur;
+      return true;
+    }
+    return false;
+  }
+
+  auto parse_string(std::string &out) -> bool
+  {
+    if (not consume('"')) {
+      return false;
+    }
+
+    out.clear();
+    while (_cur != _end and *_cur != '"') {
+      if (*_cur != '\\') {
+        out += *_cur++;
+        continue;
+      }
+
+      if (++_cur == _end) {
+        return false;
+      }
+      switch (*_cur++) {
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'u':
+        if (_end - _cur < 4) {
+          return false;
+        }
+        append_utf8(out, std::strtoul(std::string(_cur, 4).c_str(), nullptr, 16));
+        _cur += 4;
+        break;
+      default:
+        out += _cur[-1];
+        break;
+      }
+    }
+    return _cur != _end and *_cur++ == '"';
+  }
+
+  auto parse(JsonValue &value) -> bool
+  {
+    switch (peek()) {
+    case '{':
+      ++_cur;
+      value.type = JsonType::Object;
+      if (consume('}')) {
+        return true;
+      }
+      do {
+        value.object.emplace_back();
+        if (not parse_string(value.object.back().first) or not consume(':') or not parse(value.object.back().second)) {
+          return false;
+        }
+      } while (consume(','));
+      return consume('}');
+
+    case '[':
+      ++_cur;
+      value.type = JsonType::Array;
+      if (consume(']')) {
+        return true;
+      }
+      do {
+        value.array.emplace_back();
+        if (not parse(value.array.back())) {
+          return false;
+        }
+      } while (consume(','));
+      return consume(']');
+
+    case '"':
+      value.type = JsonType::String;
+      return parse_string(value.string);
+
+    case 't':
+      value.type = JsonType::Bool;
+      value.boolean = true;
+      return consume_literal("true");
+
+    case 'f':
+      value.type = JsonType::Bool;
+      value.boolean = false;
+      return consume_literal("false");
+
+    case 'n':
+      value.type = JsonType::Null;
+      return consume_literal("null");
+
+    default: {
+      char *last;
+      value.type = JsonType::Number;
+      value.number = std::strtod(_cur, &last);
+      if (last == _cur or last > _end) {
+        return false;
+      }
+      _cur = last;
+      return true;
+    }
+    }
+  }
+
+private:
+  auto skip_whitespace() -> void
+  {
+    while (_cur != _end and (*_cur == ' ' or *_cur == '\t' or *_cur == '\n' or *_cur == '\r')) {
+      ++_cur;
+    }
+  }
+
+  auto consume_literal(const char *literal) -> bool
+  {
+    auto len = std::strlen(literal);
+    if (static_cast<std::size_t>(_end - _cur) < len or std::strncmp(_cur, literal, len) != 0) {
+      return false;
+    }
+    _cur += len;
+    return true;
+  }
+
+  static auto append_utf8(std::string &out, unsigned long code) -> void
+  {
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    } else if (code < 0x800) {
+      out += static_cast<char>(0xc0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+      out += static_cast<char>(0xe0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    }
+  }
+};
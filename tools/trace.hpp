@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: 2024 Shota Minami
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "json.hpp"
+
+struct TraceEvent
+{
+  std::string name;
+  std::string cat;
+  char phase;
+  double ts;
+  double dur;
+  JsonValue args;
+
+  auto end() const -> double
+  {
+    return ts + dur;
+  }
+};
+
+class TraceFile
+{
+  std::string _path;
+  std::vector<char> _data;
+  JsonValue _metadata;
+
+public:
+  TraceFile(std::string path)
+    : _path(std::move(path))
+  {
+  }
+
+  auto path() const -> const std::string &
+  {
+    return _path;
+  }
+
+  auto data() const -> const std::vector<char> &
+  {
+    return _data;
+  }
+
+  auto metadata() const -> const JsonValue &
+  {
+    return _metadata;
+  }
+
+  auto load() -> bool
+  {
+    auto file = std::fopen(_path.c_str(), "rb");
+    if (not file) {
+      return false;
+    }
+
+    char buffer[1 << 16];
+    std::size_t len;
+    while ((len = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      _data.insert(_data.end(), buffer, buffer + len);
+    }
+    std::fclose(file);
+    _data.push_back('\0');
+    return true;
+  }
+
+  template <typename F>
+  auto for_each_event(F &&f) -> bool
+  {
+    JsonParser parser { _data.data(), _data.data() + _data.size() - 1 };
+    if (parser.peek() == '[') {
+      return read_events(parser, f);
+    }
+
+    if (not parser.consume('{')) {
+      return false;
+    }
+    if (parser.consume('}')) {
+      return true;
+    }
+    do {
+      std::string key;
+      if (not parser.parse_string(key) or not parser.consume(':')) {
+        return false;
+      }
+      if (key == "traceEvents") {
+        if (not read_events(parser, f)) {
+          return false;
+        }
+      } else if (key == "otherData") {
+        if (not parser.parse(_metadata)) {
+          return false;
+        }
+      } else {
+        JsonValue ignored;
+        if (not parser.parse(ignored)) {
+          return false;
+        }
+      }
+    } while (parser.consume(','));
+    return parser.consume('}');
+  }
+
+private:
+  template <typename F>
+  static auto read_events(JsonParser &parser, F &f) -> bool
+  {
+    if (not parser.consume('[')) {
+      return false;
+    }
+    if (parser.consume(']')) {
+      return true;
+    }
+    do {
+      JsonValue value;
+      if (not parser.parse(value) or value.type != JsonType::Object) {
+        return false;
+      }
+
+      TraceEvent event;
+      event.name = value.string_or("name", "");
+      event.cat = value.string_or("cat", "");
+      auto phase = value.string_or("ph", "");
+      event.phase = phase.empty() ? '\0' : phase[0];
+      event.ts = value.number_or("ts", 0);
+      event.dur = value.number_or("dur", 0);
+      for (auto &entry : value.object) {
+        if (entry.first == "args") {
+          event.args = std::move(entry.second);
+        }
+      }
+      f(event);
+    } while (parser.consume(','));
+    return parser.consume(']');
+  }
+};